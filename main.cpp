@@ -2,8 +2,25 @@
 #include <chrono>
 #include <optional>
 #include <vector>
+#include <map>
+#include <random>
+#include <cstdint>
+#include <climits>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
 
 #include "poly.h"
+#include "poly_ntt.h"
+#include "poly_differential.h"
+#include "poly_gf2.h"
+#include "poly_dense.h"
+#include "poly_tree.h"
+#include "poly_incremental.h"
+#include "poly_online.h"
+#include "poly_fft.h"
+#include "poly_block.h"
+#include "poly_alloc.h"
 
 std::optional<double> poly_test(polynomial& p1,
                                 polynomial& p2,
@@ -28,6 +45,1332 @@ std::optional<double> poly_test(polynomial& p1,
     return std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
 }
 
+/** Runs differential_case on rounds random inputs, returns the number of failures */
+size_t differential_test(size_t rounds)
+{
+    std::mt19937 rng(39595);
+    size_t failures = 0;
+
+    for (size_t i = 0; i < rounds; i++)
+    {
+        std::vector<uint8_t> input(4 + 6 * 128);
+        for (auto &byte : input)
+        {
+            byte = static_cast<uint8_t>(rng());
+        }
+
+        if (!differential_case(input.data(), input.size()))
+        {
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+/** Returns a polynomial with up to count random terms of power at most max_power */
+polynomial random_polynomial(std::mt19937 &rng, size_t count, power max_power, coeff max_coeff)
+{
+    form terms;
+    for (size_t i = 0; i < count; i++)
+    {
+        power p = rng() % (max_power + 1);
+        coeff c = max_coeff == 0 ? static_cast<coeff>(rng()) : static_cast<coeff>(rng() % (2 * max_coeff + 1)) - max_coeff;
+        terms.push_back({p, c});
+    }
+    return polynomial(terms.begin(), terms.end());
+}
+
+/** pow() through every engine against repeated operator*, plus closed-form single terms */
+bool pow_test()
+{
+    std::mt19937 rng(89);
+    bool ok = true;
+
+    for (int round = 0; round < 20; round++)
+    {
+        polynomial base = random_polynomial(rng, 1 + rng() % 4, 1 + rng() % 6, round % 2 ? 3 : 0);
+        polynomial expected = polynomial() + 1;
+
+        for (unsigned int n = 0; n <= 12; n++)
+        {
+            ok = ok && base.pow(n) == expected;
+            ok = ok && base.pow(n, pow_engine::squaring) == expected;
+            try
+            {
+                ok = ok && base.pow(n, pow_engine::miller) == expected;
+            }
+            catch (const std::runtime_error &)
+            {
+                // the 128-bit bound doesn't hold for this base; automatic squared instead
+            }
+            expected = expected * base;
+        }
+    }
+
+    form x_terms = {{1, 1}};
+    form two_x_cubed = {{3, 2}};
+    polynomial x(x_terms.begin(), x_terms.end());
+    polynomial y(two_x_cubed.begin(), two_x_cubed.end());
+
+    ok = ok && x.pow(UINT_MAX).canonical_form() == form{{UINT_MAX, 1}};
+    ok = ok && (x * -1).pow(UINT_MAX, pow_engine::miller).canonical_form() == form{{UINT_MAX, -1}};
+    ok = ok && y.pow(5).canonical_form() == form{{15, 32}};
+    ok = ok && y.pow(32) == polynomial(); // 2^32 wraps to 0
+    ok = ok && polynomial().pow(UINT_MAX) == polynomial();
+
+    // the limits poly.h documents: miller takes (x + 1)^115 and refuses
+    // (x + 1)^116, which automatic then squares out without throwing
+    polynomial x1 = x + 1;
+    ok = ok && x1.pow(115, pow_engine::miller) == x1.pow(115, pow_engine::squaring);
+    ok = ok && x1.pow(116) == x1.pow(115) * x1;
+    try
+    {
+        x1.pow(116, pow_engine::miller);
+        ok = false;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    // the bound check gives up quickly instead of looping n times
+    try
+    {
+        (x + 1).pow(UINT_MAX, pow_engine::miller);
+        ok = false;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    return ok;
+}
+
+/** verify_product accepts true products and rejects ones off in a single coefficient */
+bool verify_test()
+{
+    std::mt19937 rng(79);
+    bool ok = true;
+
+    for (int round = 0; round < 20; round++)
+    {
+        // small coefficients take the mod-p check, full 32-bit ones the wrapped check
+        polynomial a = random_polynomial(rng, 1 + rng() % 500, 1000, round % 2 ? 0 : 10);
+        polynomial b = random_polynomial(rng, 1 + rng() % 500, 1000, round % 2 ? 0 : 10);
+        polynomial c = a * b;
+        ok = ok && verify_product(a, b, c);
+
+        form wrong = c.canonical_form();
+        size_t k = rng() % wrong.size();
+        wrong[k].second = static_cast<coeff>(static_cast<uint32_t>(wrong[k].second) + (round % 2 ? 0x80000000u : 1u));
+        ok = ok && !verify_product(a, b, polynomial(wrong.begin(), wrong.end()));
+    }
+
+    // 2^31 (x^2 - x) vanishes mod 2^32 at every integer point, but not in the ring check
+    form a_terms = {{1, INT_MAX}, {0, -1}};
+    polynomial a(a_terms.begin(), a_terms.end());
+    form c_terms = (a * a).canonical_form();
+    for (auto &t : c_terms)
+    {
+        if (t.first == 1 || t.first == 2)
+        {
+            t.second = static_cast<coeff>(static_cast<uint32_t>(t.second) + 0x80000000u);
+        }
+    }
+    ok = ok && !verify_product(a, a, polynomial(c_terms.begin(), c_terms.end()));
+
+    return ok;
+}
+
+/** warm_up() builds the tables every product up to its size will use */
+bool warm_up_test()
+{
+    bool ok = true;
+
+    // 3000 takes 3 * 2^10, but a 2000-coefficient product takes 2^11
+    polynomial::warm_up(3000);
+    ok = ok && ntt_warm_length() >= 2048 && ntt_length(2000) == 2048;
+
+    polynomial::warm_up(5000);
+    ok = ok && ntt_warm_length() >= 8192;
+
+    return ok;
+}
+
+/** Prints the outcome of one named test, returns whether it passed */
+bool cache_test()
+{
+    std::mt19937 rng(76);
+    bool ok = true;
+    polynomial a = random_polynomial(rng, 300, 2000, 0);
+    polynomial b = random_polynomial(rng, 300, 2000, 0);
+    form lead = {{100, 1}};
+    polynomial d = random_polynomial(rng, 20, 99, 0) + polynomial(lead.begin(), lead.end());
+    polynomial product = a.multiply(b, cache_policy::bypass);
+    polynomial rest = a.remainder(d, cache_policy::bypass);
+
+    polynomial::enable_result_cache(1 << 20);
+    ok = ok && a * b == product && a * b == product && a % d == rest && a % d == rest;
+    ok = ok && b * a == product; // a different key, computed again
+    cache_stats stats = polynomial::result_cache_stats();
+    ok = ok && stats.hits == 2 && stats.misses == 3;
+
+    // one entry between a shard's share of the capacity and all of it is
+    // kept; the next one evicts it, from whichever shard it sits in
+    size_t weight = product.term_count();
+    polynomial::enable_result_cache(weight + weight / 2);
+    ok = ok && a * b == product && a * b == product;
+    stats = polynomial::result_cache_stats();
+    ok = ok && weight > stats.capacity / 16 && stats.hits == 1 && stats.entries == 1 && stats.terms == weight;
+    polynomial c = random_polynomial(rng, 300, 2000, 0);
+    polynomial ac = a * c;
+    stats = polynomial::result_cache_stats();
+    ok = ok && stats.entries == 1 && stats.evictions == 1 && stats.terms == ac.term_count() && a * c == ac;
+    polynomial::disable_result_cache();
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / ("poly_cache_test." + std::to_string(rng()));
+    polynomial::enable_disk_cache(dir.string(), 1 << 24);
+    ok = ok && a * b == product;
+    polynomial::disable_disk_cache();
+
+    // a restarted process finds the directory's key and the entry made under it
+    std::ifstream key_file(dir / ".key", std::ios::binary);
+    std::vector<char> key((std::istreambuf_iterator<char>(key_file)), std::istreambuf_iterator<char>());
+    polynomial::enable_disk_cache(dir.string(), 1 << 24);
+    ok = ok && key.size() == 16 && a * b == product;
+    stats = polynomial::result_cache_stats();
+    ok = ok && stats.disk_hits == 1;
+    polynomial::disable_disk_cache();
+
+    // below the cost threshold nothing is read or written
+    auto files = [&] { return std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()); };
+    auto before = files();
+    size_t a_terms = a.canonical_form().size();
+    size_t b_terms = b.canonical_form().size();
+    size_t d_terms = d.canonical_form().size();
+    polynomial::enable_disk_cache(dir.string(), 1 << 24, a_terms * b_terms + 1);
+    ok = ok && a * b == product && a % d == rest && files() == before;
+    stats = polynomial::result_cache_stats();
+    ok = ok && stats.disk_hits == 0 && stats.disk_misses == 0;
+    polynomial::enable_disk_cache(dir.string(), 1 << 24, a_terms * d_terms);
+    ok = ok && a % d == rest && files() == before + 1;
+    polynomial::disable_disk_cache();
+
+    std::filesystem::remove_all(dir);
+    return ok;
+}
+
+/** Dense GF(2) reference: bit i is the parity of the x^i coefficient */
+std::vector<uint8_t> gf2_bits(const form &terms)
+{
+    std::vector<uint8_t> bits;
+    for (auto &t : terms)
+    {
+        bits.resize(std::max<size_t>(bits.size(), t.first + 1), 0);
+        bits[t.first] ^= t.second & 1;
+    }
+    while (!bits.empty() && bits.back() == 0)
+    {
+        bits.pop_back();
+    }
+    return bits;
+}
+
+form gf2_form(const std::vector<uint8_t> &bits)
+{
+    form out;
+    for (size_t i = bits.size(); i-- > 0;)
+    {
+        if (bits[i])
+        {
+            out.push_back({i, 1});
+        }
+    }
+    return out.empty() ? form{{0, 0}} : out;
+}
+
+bool gf2_test()
+{
+    std::mt19937 rng(81);
+    bool ok = true;
+
+    // word boundaries, the Karatsuba cutoff (16 words) and the Barrett one (degree 256)
+    const power degrees[] = {0, 1, 63, 64, 65, 255, 256, 1023, 1024, 1100, 5000};
+    for (power da : degrees)
+    {
+        for (power db : degrees)
+        {
+            form a_terms = {{da, 1}};
+            form b_terms = {{db, -1}}; // odd negative coefficients count as 1
+            for (size_t i = 0; i < da; i++)
+            {
+                a_terms.push_back({rng() % da, static_cast<coeff>(rng())});
+            }
+            for (size_t i = 0; i < db / 2; i++)
+            {
+                b_terms.push_back({rng() % db, static_cast<coeff>(rng())});
+            }
+            gf2_polynomial a(a_terms.begin(), a_terms.end());
+            gf2_polynomial b(b_terms.begin(), b_terms.end());
+            std::vector<uint8_t> x = gf2_bits(a_terms);
+            std::vector<uint8_t> y = gf2_bits(b_terms);
+
+            std::vector<uint8_t> product(x.size() + y.size() - 1, 0);
+            for (size_t i = 0; i < x.size(); i++)
+            {
+                for (size_t j = 0; x[i] && j < y.size(); j++)
+                {
+                    product[i + j] ^= y[j];
+                }
+            }
+            ok = ok && (a * b).canonical_form() == gf2_form(product);
+            ok = ok && (a * b).find_degree_of() == da + db;
+
+            std::vector<uint8_t> rest = x;
+            for (size_t i = rest.size(); i-- >= y.size();)
+            {
+                for (size_t j = 0; rest[i] && j < y.size(); j++)
+                {
+                    rest[i - (y.size() - 1) + j] ^= y[j];
+                }
+            }
+            ok = ok && (a % b).canonical_form() == gf2_form(rest);
+        }
+    }
+
+    gf2_polynomial zero;
+    form one_terms = {{0, 3}};
+    gf2_polynomial one(one_terms.begin(), one_terms.end());
+    ok = ok && (zero * one) == zero && (one * 2) == zero && (one * -7) == one && one + 1 == zero;
+    ok = ok && zero.canonical_form() == form{{0, 0}} && (one % one) == zero;
+    try
+    {
+        one % zero;
+        ok = false;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    return ok;
+}
+
+/** p folded modulo x^n - 1, or x^n + 1 if negacyclic */
+form wrapped_form(const polynomial &p, size_t n, bool negacyclic)
+{
+    std::map<power, uint32_t, std::greater<power>> acc;
+    for (auto &t : p.canonical_form())
+    {
+        uint32_t c = static_cast<uint32_t>(t.second);
+        acc[static_cast<power>(t.first % n)] += negacyclic && (t.first / n) % 2 ? 0u - c : c;
+    }
+    form out;
+    for (auto &t : acc)
+    {
+        if (t.second != 0)
+        {
+            out.push_back({t.first, static_cast<coeff>(t.second)});
+        }
+    }
+    return out.empty() ? form{{0, 0}} : out;
+}
+
+bool wrapped_test()
+{
+    std::mt19937 rng(82);
+    bool ok = true;
+
+    // n = 1, non-smooth sizes, the three transform shapes, and n past the product's degree
+    const size_t sizes[] = {1, 2, 7, 97, 1000, 4096, 3 << 10, 5 << 11, 65537, 1 << 17};
+    for (size_t n : sizes)
+    {
+        for (power max_power : {power(10), power(3 * n / 2), power(40000)})
+        {
+            polynomial a = random_polynomial(rng, 1 + rng() % 2000, max_power, 0);
+            polynomial b = random_polynomial(rng, 1 + rng() % 2000, max_power, 0);
+            polynomial full = a * b;
+            ok = ok && a.multiply_cyclic(b, n).canonical_form() == wrapped_form(full, n, false);
+            ok = ok && a.multiply_negacyclic(b, n).canonical_form() == wrapped_form(full, n, true);
+        }
+    }
+
+    polynomial x = random_polynomial(rng, 10, 20, 0);
+    ok = ok && x.multiply_cyclic(polynomial(), 8) == polynomial();
+    for (bool negacyclic : {false, true})
+    {
+        try
+        {
+            negacyclic ? x.multiply_negacyclic(x, 0) : x.multiply_cyclic(x, 0);
+            ok = false;
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+    }
+
+    return ok;
+}
+
+bool sort_reduce_test()
+{
+    std::mt19937 rng(83);
+    bool ok = true;
+    const int saved_threads = polynomial::max_threads();
+
+    // single terms, spans needing one to all radix passes, and past the automatic cutoff
+    const power spans[] = {0, 200, 70000, std::numeric_limits<power>::max() / 2};
+    for (power span : spans)
+    {
+        for (size_t count : {size_t(1), size_t(30), size_t(600)})
+        {
+            polynomial a = random_polynomial(rng, count, span, count % 2 ? 0 : 5);
+            polynomial b = random_polynomial(rng, 1 + rng() % count, span, 0);
+            polynomial expected = a.multiply(b, mult_engine::schoolbook);
+            for (int threads : {1, 3, 8})
+            {
+                polynomial::set_max_threads(threads);
+                ok = ok && a.multiply(b, mult_engine::sort_reduce) == expected;
+                ok = ok && a * b == expected;
+            }
+        }
+    }
+    polynomial::set_max_threads(saved_threads);
+
+    // runs that sum to zero drop out: the cross terms of (x^k + 1)(x^k - 1)
+    form plus = {{1000, 1}, {0, 1}};
+    form minus = {{1000, 1}, {0, -1}};
+    polynomial p(plus.begin(), plus.end());
+    polynomial q(minus.begin(), minus.end());
+    ok = ok && p.multiply(q, mult_engine::sort_reduce).canonical_form() == form{{2000, 1}, {0, -1}};
+    ok = ok && polynomial().multiply(q, mult_engine::sort_reduce) == polynomial();
+
+    // and so do runs that only vanish mod 2^32
+    form half = {{1, 65536}, {0, 65536}};
+    polynomial h(half.begin(), half.end());
+    ok = ok && h.multiply(h, mult_engine::sort_reduce) == polynomial();
+
+    return ok;
+}
+
+bool monomial_test()
+{
+    std::mt19937 rng(84);
+    bool ok = true;
+
+    const coeff scales[] = {1, -1, 3, 65536, INT_MIN, static_cast<coeff>(rng())};
+    const power shifts[] = {0, 1, 777, std::numeric_limits<power>::max() / 2};
+    for (size_t count : {size_t(1), size_t(17), size_t(10000)})
+    {
+        polynomial p = random_polynomial(rng, count, 50000, 0);
+        for (coeff c : scales)
+        {
+            for (power k : shifts)
+            {
+                form m_terms = {{k, c}};
+                polynomial m(m_terms.begin(), m_terms.end());
+                polynomial expected = p.multiply(m, mult_engine::schoolbook);
+                ok = ok && p * m == expected && m * p == expected;
+            }
+        }
+        ok = ok && p * polynomial() == polynomial() && polynomial() * p == polynomial();
+    }
+
+    // 65536^2 wraps every coefficient to 0
+    form wide = {{3, 65536}, {1, 65536}};
+    form scale = {{2, 65536}};
+    ok = ok && polynomial(wide.begin(), wide.end()) * polynomial(scale.begin(), scale.end()) == polynomial();
+
+    return ok;
+}
+
+/** count consecutive random coefficients from x^low up, for the dense paths */
+polynomial dense_polynomial(std::mt19937 &rng, size_t count, power low)
+{
+    form terms;
+    for (size_t i = 0; i < count; i++)
+    {
+        terms.push_back({low + i, static_cast<coeff>(rng())});
+    }
+    return polynomial(terms.begin(), terms.end());
+}
+
+bool unbalanced_test()
+{
+    std::mt19937 rng(85);
+    bool ok = true;
+    const int saved_threads = polynomial::max_threads();
+
+    // short sides of 1 and 2, long sides that are and aren't a multiple of them
+    const std::pair<size_t, size_t> shapes[] = {{1, 1}, {1, 500}, {2, 1001}, {37, 1009}, {64, 64 * 40}, {300, 20000}};
+    for (auto shape : shapes)
+    {
+        for (bool dense : {true, false})
+        {
+            if (!dense && shape.second > 5000)
+            {
+                continue; // the map-based sparse reference alone would take seconds
+            }
+            polynomial a = dense ? dense_polynomial(rng, shape.first, 5) : random_polynomial(rng, shape.first, 1 << 20, 0);
+            polynomial b = dense ? dense_polynomial(rng, shape.second, 0) : random_polynomial(rng, shape.second, 1 << 20, 0);
+            polynomial expected = a.multiply(b, mult_engine::schoolbook);
+            for (int threads : {1, 3, 8})
+            {
+                polynomial::set_max_threads(threads);
+                ok = ok && a.multiply(b, mult_engine::unbalanced) == expected;
+                ok = ok && b.multiply(a, mult_engine::unbalanced) == expected;
+                ok = ok && (!dense || b.multiply(a, mult_engine::karatsuba) == expected);
+                ok = ok && a * b == expected;
+            }
+        }
+    }
+    polynomial::set_max_threads(saved_threads);
+
+    // the dense kernels agree with each other at odd lengths and on empty input
+    for (size_t n : {size_t(0), size_t(1), size_t(31), size_t(33), size_t(1000)})
+    {
+        for (size_t m : {size_t(1), size_t(7), size_t(999)})
+        {
+            dense_coeffs x(n), y(m);
+            for (auto &c : x)
+            {
+                c = rng();
+            }
+            for (auto &c : y)
+            {
+                c = rng();
+            }
+            dense_coeffs expected = schoolbook_multiply(x, y);
+            ok = ok && expected.size() == (n == 0 ? 0 : n + m - 1);
+            ok = ok && karatsuba_multiply(x, y) == expected && karatsuba_multiply(y, x) == expected;
+            ok = ok && dense_multiply(x, y, 4) == expected;
+        }
+    }
+
+    return ok;
+}
+
+bool product_tree_test()
+{
+    std::mt19937 rng(86);
+    bool ok = true;
+    const int saved_threads = polynomial::max_threads();
+
+    // no factors, one, odd counts that carry a node up, and more factors than threads
+    for (size_t count : {size_t(0), size_t(1), size_t(2), size_t(3), size_t(17), size_t(100)})
+    {
+        std::vector<polynomial> factors;
+        polynomial expected = polynomial() + 1;
+        for (size_t i = 0; i < count; i++)
+        {
+            factors.push_back(random_polynomial(rng, 1 + rng() % 40, 1 + rng() % 200, i % 2 ? 3 : 0));
+            expected = expected * factors.back();
+        }
+
+        for (int threads : {1, 3, 8})
+        {
+            polynomial::set_max_threads(threads);
+            product_tree tree(factors);
+            ok = ok && tree.root() == expected && product(factors) == expected;
+
+            const auto &levels = tree.levels();
+            ok = ok && levels.back().size() == 1;
+            for (size_t k = 0; k + 1 < levels.size(); k++)
+            {
+                ok = ok && levels[k + 1].size() == (levels[k].size() + 1) / 2;
+                for (size_t i = 0; 2 * i + 1 < levels[k].size(); i++)
+                {
+                    ok = ok && levels[k + 1][i] == levels[k][2 * i] * levels[k][2 * i + 1];
+                }
+            }
+        }
+    }
+    polynomial::set_max_threads(saved_threads);
+
+    return ok;
+}
+
+/** A random polynomial of degree exactly degree with leading coefficient lead */
+polynomial with_lead(std::mt19937 &rng, power degree, coeff lead, coeff max_coeff)
+{
+    form lead_term = {{degree, lead}};
+    polynomial rest = degree == 0 ? polynomial() : random_polynomial(rng, 1 + rng() % 20, degree - 1, max_coeff);
+    return rest + polynomial(lead_term.begin(), lead_term.end());
+}
+
+bool remainder_tree_test()
+{
+    std::mt19937 rng(87);
+    bool ok = true;
+
+    for (size_t count : {size_t(1), size_t(2), size_t(5), size_t(33)})
+    {
+        std::vector<polynomial> moduli;
+        for (size_t i = 0; i < count; i++)
+        {
+            power degree = i == 0 ? 0 : rng() % 30;
+            moduli.push_back(with_lead(rng, degree, i % 2 ? -1 : 1, 0));
+        }
+        product_tree tree(moduli);
+
+        for (power f_degree : {power(0), power(5), power(2000)})
+        {
+            polynomial f = random_polynomial(rng, 1 + rng() % 300, f_degree, 0);
+            std::vector<polynomial> r = remainders(f, tree);
+            ok = ok && r.size() == count;
+            for (size_t i = 0; i < count; i++)
+            {
+                ok = ok && r[i] == f % moduli[i];
+            }
+        }
+        ok = ok && remainders(polynomial(), tree) == std::vector<polynomial>(count, polynomial());
+    }
+
+    // a leading coefficient of 3 takes the direct fallback; truncating division
+    // only terminates when it divides exactly, so f is built as q m + r
+    polynomial m3 = with_lead(rng, 12, 3, 5);
+    polynomial q = random_polynomial(rng, 30, 40, 5);
+    polynomial r3 = random_polynomial(rng, 8, 11, 5);
+    polynomial x = with_lead(rng, 7, 1, 0);
+    polynomial f = q * m3 + r3;
+    std::vector<polynomial> r = remainders(f, product_tree({x, m3}));
+    ok = ok && r.size() == 2 && r[0] == f % x && r[1] == r3 && r[1] == f % m3;
+
+    try
+    {
+        remainders(polynomial() + 1, product_tree({polynomial() + 1, polynomial()}));
+        ok = false;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    return ok;
+}
+
+bool crt_test()
+{
+    std::mt19937 rng(88);
+    bool ok = true;
+
+    // irreducible mod 2, so pairwise coprime; the even parts added below keep them so
+    const form irreducible[] = {{{1, 1}}, {{1, 1}, {0, 1}}, {{2, 1}, {1, 1}, {0, 1}}, {{3, 1}, {1, 1}, {0, 1}},
+                                {{3, 1}, {2, 1}, {0, 1}}, {{4, 1}, {1, 1}, {0, 1}}, {{5, 1}, {2, 1}, {0, 1}}};
+    for (size_t count : {size_t(1), size_t(2), size_t(4), size_t(7)})
+    {
+        std::vector<polynomial> moduli;
+        std::vector<polynomial> residues;
+        for (size_t i = 0; i < count; i++)
+        {
+            form base = irreducible[i];
+            polynomial m = polynomial(base.begin(), base.end()) * (i % 2 ? -1 : 1);
+            if (base[0].first > 1)
+            {
+                m = m + 2 * random_polynomial(rng, 3, base[0].first - 1, 0);
+            }
+            moduli.push_back(m);
+            residues.push_back(random_polynomial(rng, 1 + rng() % 4, base[0].first - 1, 0));
+        }
+        product_tree tree(moduli);
+
+        polynomial f = chinese_remainder(residues, tree);
+        ok = ok && (f == polynomial() || f.canonical_form()[0].first < tree.root().canonical_form()[0].first);
+        for (size_t i = 0; i < count; i++)
+        {
+            ok = ok && f % moduli[i] == residues[i];
+        }
+        ok = ok && remainders(f, tree) == residues;
+        ok = ok && chinese_remainder(std::vector<polynomial>(count, polynomial()), tree) == polynomial();
+    }
+
+    // x and x + 2 share x mod 2; a leading 3 isn't a unit; one residue short
+    form x = {{1, 1}};
+    form x_plus_2 = {{1, 1}, {0, 2}};
+    form three_x_plus_1 = {{1, 3}, {0, 1}};
+    const std::vector<std::vector<polynomial>> bad_moduli = {
+        {polynomial(x.begin(), x.end()), polynomial(x_plus_2.begin(), x_plus_2.end())},
+        {polynomial(x.begin(), x.end()), polynomial(three_x_plus_1.begin(), three_x_plus_1.end())}};
+    for (const auto &moduli : bad_moduli)
+    {
+        try
+        {
+            chinese_remainder({polynomial(), polynomial()}, product_tree(moduli));
+            ok = false;
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+    }
+    try
+    {
+        chinese_remainder({polynomial()}, product_tree({polynomial(x.begin(), x.end()), polynomial(x.begin(), x.end()) + 1}));
+        ok = false;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    return ok;
+}
+
+/** x^k, or c x^k */
+polynomial monomial(power k, coeff c = 1)
+{
+    form term = {{k, c}};
+    return polynomial(term.begin(), term.end());
+}
+
+bool coefficient_test()
+{
+    std::mt19937 rng(90);
+    bool ok = true;
+
+    for (bool dense : {true, false})
+    {
+        for (size_t count : {size_t(1), size_t(50), size_t(3000)})
+        {
+            polynomial a = dense ? dense_polynomial(rng, count, 3) : random_polynomial(rng, count, 100000, 0);
+            polynomial b = dense ? dense_polynomial(rng, 1 + rng() % count, 0) : random_polynomial(rng, 1 + rng() % count, 100000, 0);
+            polynomial c = a * b;
+            power top = c.canonical_form()[0].first;
+
+            // the ends, just past them, and random points and windows in between
+            std::vector<power> points = {0, 1, 2, 3, top, top + 1, std::numeric_limits<power>::max()};
+            for (int i = 0; i < 20; i++)
+            {
+                points.push_back(rng() % (top + 1));
+            }
+            for (power k : points)
+            {
+                ok = ok && coefficient_of_product(a, b, k) == c.coefficient(k);
+                ok = ok && coefficient_of_product(b, a, k) == c.coefficient(k);
+            }
+
+            for (int i = 0; i < 10; i++)
+            {
+                power low = i == 0 ? 0 : rng() % (top + 1);
+                power high = i == 0 ? top + 5 : i == 1 ? low : low + rng() % (top + 1 - low);
+                std::vector<coeff> window = coefficients_of_product(a, b, low, high);
+                ok = ok && window.size() == std::min(high, top) - low + 1;
+                for (power k = low; k <= std::min(high, top) && ok; k++)
+                {
+                    ok = ok && window[k - low] == c.coefficient(k);
+                }
+            }
+        }
+    }
+
+    // windows reaching the largest power, where high - low + 1 would wrap,
+    // and windows wholly above the product
+    const power max = std::numeric_limits<power>::max();
+    polynomial y = dense_polynomial(rng, 40, 0);
+    polynomial z = random_polynomial(rng, 30, 50, 0);
+    polynomial yz = y * z;
+    power yz_top = yz.canonical_form()[0].first;
+    std::vector<coeff> all = coefficients_of_product(y, z, 0, max);
+    ok = ok && all.size() == yz_top + 1 && all[0] == yz.coefficient(0) && all.back() == yz.coefficient(yz_top);
+    ok = ok && coefficients_of_product(z, z, 0, max).size() == z.canonical_form()[0].first * 2 + 1;
+    ok = ok && coefficients_of_product(y, z, yz_top + 1, max).empty();
+    ok = ok && coefficients_of_product(monomial(max), monomial(0, 3), max, max) == std::vector<coeff>{3};
+
+    polynomial x = random_polynomial(rng, 10, 10, 0);
+    ok = ok && polynomial().coefficient(0) == 0 && x.coefficient(11) == 0;
+    for (auto &t : x.canonical_form())
+    {
+        ok = ok && x.coefficient(t.first) == t.second;
+    }
+    try
+    {
+        coefficients_of_product(x, x, 5, 4);
+        ok = false;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    return ok;
+}
+
+bool maintained_product_test()
+{
+    std::mt19937 rng(91);
+    bool ok = true;
+
+    for (size_t batch : {size_t(0), size_t(1), size_t(64), size_t(100000)})
+    {
+        polynomial a = random_polynomial(rng, 1 + rng() % 200, 5000, 0);
+        polynomial b = random_polynomial(rng, 1, 5000, 0);
+        maintained_product m(a, b);
+        m.set_batch_limit(batch);
+
+        for (int step = 0; step < 300; step++)
+        {
+            power k = rng() % 6000;
+            coeff delta = static_cast<coeff>(rng());
+            form term = {{k, delta}};
+            switch (rng() % 4)
+            {
+            case 0:
+                m.update_a(k, delta);
+                a = a + polynomial(term.begin(), term.end());
+                break;
+            case 1:
+                m.update_b(k, delta);
+                b = b + polynomial(term.begin(), term.end());
+                break;
+            case 2:
+            {
+                // remove an existing term of a entirely
+                auto terms = a.canonical_form();
+                auto t = terms[rng() % terms.size()];
+                form removal = {{t.first, static_cast<coeff>(0u - static_cast<uint32_t>(t.second))}};
+                m.update_a(removal[0].first, removal[0].second);
+                a = a + polynomial(removal.begin(), removal.end());
+                break;
+            }
+            default:
+            {
+                polynomial delta_b = random_polynomial(rng, 1 + rng() % 30, 6000, 0);
+                m.update_b(delta_b);
+                b = b + delta_b;
+                break;
+            }
+            }
+
+            if (step % 37 == 0)
+            {
+                ok = ok && m.product() == a * b;
+            }
+        }
+        ok = ok && m.a() == a && m.b() == b && m.product() == a * b;
+        m.flush();
+        ok = ok && m.product() == a * b;
+    }
+
+    // cancel every term of a: the product goes to 0 and comes back
+    polynomial a = random_polynomial(rng, 20, 100, 0);
+    polynomial b = random_polynomial(rng, 20, 100, 0);
+    maintained_product m(a, b);
+    m.update_a(a * -1);
+    ok = ok && m.a() == polynomial() && m.product() == polynomial();
+    m.update_a(a);
+    ok = ok && m.product() == a * b;
+
+    // p += p, with a coefficient that doubles to 0 mod 2^32
+    form halves = {{7, INT_MIN}, {3, 5}, {0, INT_MIN}};
+    polynomial p(halves.begin(), halves.end());
+    polynomial doubled = p * 2;
+    p += p;
+    ok = ok && p == doubled && p.canonical_form() == form{{3, 10}};
+    polynomial zero;
+    zero += zero;
+    ok = ok && zero == polynomial();
+    ok = ok && p.term_count() == 1 && zero.term_count() == 0 && a.term_count() == a.canonical_form().size();
+
+    return ok;
+}
+
+bool online_product_test()
+{
+    std::mt19937 rng(92);
+    bool ok = true;
+
+    // block boundaries either side of powers of two, and a long non-smooth run
+    for (size_t n : {size_t(1), size_t(2), size_t(3), size_t(63), size_t(64), size_t(65), size_t(1000), size_t(5003)})
+    {
+        form a_terms, b_terms;
+        std::vector<coeff> a_coeffs(n), b_coeffs(n);
+        for (size_t k = 0; k < n; k++)
+        {
+            // some zero stretches, so not every coefficient is a term
+            a_coeffs[k] = rng() % 5 == 0 ? 0 : static_cast<coeff>(rng());
+            b_coeffs[k] = k % 7 == 3 ? 0 : static_cast<coeff>(rng());
+            a_terms.push_back({k, a_coeffs[k]});
+            b_terms.push_back({k, b_coeffs[k]});
+        }
+        polynomial full = polynomial(a_terms.begin(), a_terms.end()) * polynomial(b_terms.begin(), b_terms.end());
+
+        online_product online;
+        form prefix_terms;
+        for (size_t k = 0; k < n; k++)
+        {
+            coeff c = online.push(a_coeffs[k], b_coeffs[k]);
+            ok = ok && c == full.coefficient(k) && online.size() == k + 1;
+            prefix_terms.push_back({k, c});
+        }
+        ok = ok && online.prefix() == polynomial(prefix_terms.begin(), prefix_terms.end());
+    }
+
+    ok = ok && online_product().size() == 0 && online_product().prefix() == polynomial();
+
+    return ok;
+}
+
+dense_coeffs random_coeffs(std::mt19937 &rng, size_t n)
+{
+    dense_coeffs out(n);
+    for (auto &c : out)
+    {
+        c = rng();
+    }
+    return out;
+}
+
+bool middle_product_test()
+{
+    std::mt19937 rng(93);
+    bool ok = true;
+
+    // n = 1, m = 1, odd and non-smooth lengths, and lengths past the NTT crossover
+    const std::pair<size_t, size_t> shapes[] = {{1, 1}, {1, 9}, {9, 1}, {2, 2}, {31, 33}, {100, 7}, {1000, 1000}, {3001, 2999}};
+    for (auto shape : shapes)
+    {
+        size_t m = shape.first;
+        size_t n = shape.second;
+        dense_coeffs a = random_coeffs(rng, m + n - 1);
+        dense_coeffs b = random_coeffs(rng, n);
+        dense_coeffs full = schoolbook_multiply(a, b);
+        dense_coeffs expected(full.begin() + (n - 1), full.begin() + (m + n - 1));
+
+        ok = ok && schoolbook_middle_product(a, b) == expected;
+        ok = ok && karatsuba_middle_product(a, b) == expected;
+        ok = ok && dense_middle_product(a, b, 4) == expected;
+        ok = ok && ntt_middle_product(a, b, 4) == expected;
+
+        dense_coeffs transposed(m, 0);
+        for (size_t i = 0; i < m; i++)
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                transposed[i] += b[j] * a[i + j];
+            }
+        }
+        ok = ok && transposed_multiply(b, a, 4) == transposed;
+    }
+
+    ok = ok && dense_middle_product(random_coeffs(rng, 3), random_coeffs(rng, 4), 4).empty();
+    ok = ok && dense_middle_product(random_coeffs(rng, 3), dense_coeffs(), 4).empty();
+
+    // f g = 1 mod x^n, for f_0 = 1 and f_0 = -1
+    for (size_t n : {size_t(1), size_t(2), size_t(17), size_t(1000), size_t(4099)})
+    {
+        for (uint32_t f0 : {1u, 0xffffffffu})
+        {
+            dense_coeffs f = random_coeffs(rng, 1 + rng() % (2 * n));
+            f[0] = f0;
+            dense_coeffs g = inverse_series(f, n, 4);
+            dense_coeffs fg = schoolbook_multiply(f, g);
+            fg.resize(n);
+            dense_coeffs one(n, 0);
+            one[0] = 1;
+            ok = ok && g.size() == n && fg == one;
+        }
+    }
+
+    // a = q d + r with deg r < deg d, so r is the only right answer for a monic or
+    // negated-monic d, whichever remainder path operator% takes
+    // (the last two are long enough for the cyclic q d, with a ring just above
+    // deg d and one exactly deg d long)
+    for (auto sizes : {std::pair<size_t, size_t>{1, 1}, {5, 1}, {3, 10}, {3000, 1}, {3000, 1500}, {20000, 333}, {5000, 5000}, {9000, 4097}})
+    {
+        polynomial q = dense_polynomial(rng, sizes.first, 0);
+        polynomial d = with_lead(rng, static_cast<power>(sizes.second - 1), sizes.second % 2 ? 1 : -1, 0);
+        polynomial r = sizes.second == 1 ? polynomial() : random_polynomial(rng, 50, static_cast<power>(sizes.second - 2), 0);
+        polynomial a = q * d + r;
+        ok = ok && a % d == r && a.remainder(d, cache_policy::bypass) == r;
+
+        form a_form = a.canonical_form();
+        form d_form = d.canonical_form();
+        dense_coeffs a_dense(a_form[0].first + 1, 0), d_dense(d_form[0].first + 1, 0);
+        for (auto &t : a_form)
+        {
+            a_dense[t.first] = static_cast<uint32_t>(t.second);
+        }
+        for (auto &t : d_form)
+        {
+            d_dense[t.first] = static_cast<uint32_t>(t.second);
+        }
+        dense_coeffs rest = dense_remainder(a_dense, d_dense, 4);
+        ok = ok && rest.size() == d_dense.size() - 1;
+        for (size_t k = 0; k < rest.size(); k++)
+        {
+            ok = ok && static_cast<coeff>(rest[k]) == r.coefficient(k);
+        }
+    }
+
+    return ok;
+}
+
+/** Whether n is 2^k, 3 * 2^k or 5 * 2^k */
+bool smooth_length(size_t n)
+{
+    while (n % 2 == 0)
+    {
+        n /= 2;
+    }
+    return n == 1 || n == 3 || n == 5;
+}
+
+bool mixed_radix_test()
+{
+    std::mt19937 rng(94);
+    bool ok = true;
+
+    std::vector<size_t> lengths = {1, 2, 3, 4, 5, 6, 7, 97, NTT_MAX_LENGTH - 1, NTT_MAX_LENGTH};
+    for (size_t k = 2; k < 22; k++)
+    {
+        for (size_t shape : {size_t(1) << k, size_t(3) << k, size_t(5) << k})
+        {
+            lengths.insert(lengths.end(), {shape - 1, shape, shape + 1});
+        }
+    }
+    for (size_t length : lengths)
+    {
+        size_t n = ntt_length(length);
+        size_t power_of_two = 1;
+        while (power_of_two < length)
+        {
+            power_of_two *= 2;
+        }
+        ok = ok && (length > NTT_MAX_LENGTH ? n == 0 : n >= length && n <= power_of_two && smooth_length(n));
+    }
+    ok = ok && ntt_length(NTT_MAX_LENGTH + 1) == 0;
+
+    // products landing exactly on, just under and just over each transform shape
+    for (size_t shape : {size_t(1), size_t(2), size_t(3), size_t(5), size_t(3) << 6, size_t(5) << 6, size_t(3) << 11, size_t(5) << 11})
+    {
+        for (size_t length : {shape, shape + 1, shape > 1 ? shape - 1 : shape})
+        {
+            size_t na = 1 + rng() % length;
+            dense_coeffs a = random_coeffs(rng, na);
+            dense_coeffs b = random_coeffs(rng, length + 1 - na);
+            dense_coeffs expected = schoolbook_multiply(a, b);
+            for (int threads : {1, 3})
+            {
+                ok = ok && ntt_multiply(a, b, threads) == expected;
+            }
+        }
+    }
+
+    // cyclic and negacyclic transforms of every supported shape, against a folded product
+    for (size_t n : {size_t(1), size_t(2), size_t(3), size_t(5), size_t(6), size_t(10), size_t(3) << 10, size_t(5) << 10, size_t(1) << 12})
+    {
+        for (bool negacyclic : {false, true})
+        {
+            ok = ok && ntt_cyclic_supported(n, negacyclic);
+            dense_coeffs a = random_coeffs(rng, n);
+            dense_coeffs b = random_coeffs(rng, n);
+            dense_coeffs full = schoolbook_multiply(a, b);
+            dense_coeffs expected(n, 0);
+            for (size_t i = 0; i < full.size(); i++)
+            {
+                expected[i % n] += negacyclic && i >= n ? 0u - full[i] : full[i];
+            }
+            ok = ok && ntt_multiply_cyclic(a, b, negacyclic, 4) == expected;
+        }
+    }
+    ok = ok && !ntt_cyclic_supported(7, false) && !ntt_cyclic_supported(0, false);
+    ok = ok && !ntt_cyclic_supported(NTT_MAX_LENGTH, true) && !ntt_cyclic_supported(NTT_MAX_LENGTH * 2, false);
+
+    return ok;
+}
+
+bool six_step_test()
+{
+    std::mt19937 rng(95);
+    bool ok = true;
+    const size_t saved_cutoff = ntt_six_step_cutoff();
+
+    // forced down to tiny transforms, against schoolbook
+    for (size_t cutoff : {size_t(4), size_t(64), size_t(1024)})
+    {
+        set_ntt_six_step_cutoff(cutoff);
+        for (size_t length : {size_t(4), size_t(5), size_t(63), size_t(64), size_t(65), size_t(3) << 8, size_t(5) << 9, size_t(4099)})
+        {
+            size_t na = 1 + rng() % length;
+            dense_coeffs a = random_coeffs(rng, na);
+            dense_coeffs b = random_coeffs(rng, length + 1 - na);
+            dense_coeffs expected = schoolbook_multiply(a, b);
+            for (int threads : {1, 2, 4, 8})
+            {
+                ok = ok && ntt_multiply(a, b, threads) == expected;
+            }
+
+            // the cyclic path only goes six-step with more than three threads
+            size_t n = ntt_length(length);
+            dense_coeffs x = random_coeffs(rng, n);
+            dense_coeffs y = random_coeffs(rng, n);
+            dense_coeffs full = schoolbook_multiply(x, y);
+            for (bool negacyclic : {false, true})
+            {
+                if (!ntt_cyclic_supported(n, negacyclic))
+                {
+                    continue;
+                }
+                dense_coeffs wrapped(n, 0);
+                for (size_t i = 0; i < full.size(); i++)
+                {
+                    wrapped[i % n] += negacyclic && i >= n ? 0u - full[i] : full[i];
+                }
+                ok = ok && ntt_multiply_cyclic(x, y, negacyclic, 8) == wrapped;
+            }
+        }
+    }
+
+    // at the default cutoff, against the plain transform with six-step turned off
+    dense_coeffs a = random_coeffs(rng, 700000);
+    dense_coeffs b = random_coeffs(rng, 600000);
+    set_ntt_six_step_cutoff(SIZE_MAX);
+    dense_coeffs plain = ntt_multiply(a, b, 8);
+    set_ntt_six_step_cutoff(saved_cutoff);
+    ok = ok && ntt_multiply(a, b, 8) == plain && ntt_multiply(a, b, 1) == plain;
+    ok = ok && plain[0] == a[0] * b[0] && plain.back() == a.back() * b.back();
+
+    return ok;
+}
+
+bool fft_test()
+{
+    std::mt19937 rng(97);
+    bool ok = true;
+
+    // coefficients whose balanced digits sit at the ends of their ranges
+    const uint32_t extremes[] = {0, 1, 0x3ff, 0x400, 0x7ff, 0x3ff800, 0x400400, 0x7fffffff, 0x80000000, 0xffbffbff, 0xffffffff};
+
+    for (size_t length : {size_t(1), size_t(2), size_t(3), size_t(1000), size_t(4097), size_t(20000), size_t(32767)})
+    {
+        for (int fill = 0; fill < 3; fill++)
+        {
+            size_t na = 1 + rng() % length;
+            dense_coeffs a = random_coeffs(rng, na);
+            dense_coeffs b = random_coeffs(rng, length + 1 - na);
+            for (auto *x : {&a, &b})
+            {
+                for (auto &c : *x)
+                {
+                    // random, one extreme value throughout (a flat spectrum peak), or mixed extremes
+                    c = fill == 0 ? c : fill == 1 ? extremes[9] : extremes[c % 11];
+                }
+            }
+
+            dense_coeffs out;
+            if (fft_multiply(a, b, 4, out))
+            {
+                ok = ok && out == karatsuba_multiply(a, b);
+            }
+            else
+            {
+                ok = ok && length > 2000; // short products always fit the bound
+            }
+        }
+    }
+
+    // too long for the bound: refused, and mult_engine::fft falls back to the NTT
+    dense_coeffs a = random_coeffs(rng, 1 << 17);
+    dense_coeffs out;
+    ok = ok && !fft_multiply(a, a, 4, out) && out.empty();
+    polynomial x = dense_polynomial(rng, 1 << 17, 0);
+    ok = ok && x.multiply(x, mult_engine::fft) == x.multiply(x, mult_engine::ntt);
+
+    // small coefficients keep the FFT much longer
+    dense_coeffs small(1 << 18);
+    for (auto &c : small)
+    {
+        c = static_cast<uint32_t>(static_cast<int>(rng() % 7) - 3);
+    }
+    ok = ok && fft_multiply(small, small, 4, out) && out == ntt_multiply(small, small, 4);
+    ok = ok && fft_multiply(dense_coeffs(), small, 4, out) && out.empty();
+
+    return ok;
+}
+
+template <typename F>
+bool throws_overflow(F f)
+{
+    try
+    {
+        f();
+    }
+    catch (const std::overflow_error &)
+    {
+        return true;
+    }
+    return false;
+}
+
+bool power_range_test()
+{
+    std::mt19937 rng(98);
+    bool ok = true;
+    const power top = std::numeric_limits<power>::max();
+
+    // right up to the largest power, and one past it, through every sparse path
+    polynomial half = monomial(top / 2);
+    polynomial over = monomial(top / 2 + 1) + random_polynomial(rng, 20, 1000, 0);
+    ok = ok && (half * half).canonical_form() == form{{top / 2 * 2, 1}};
+    ok = ok && (monomial(top - 5) * (monomial(5) + 1)).canonical_form() == form{{top, 1}, {top - 5, 1}};
+    ok = ok && throws_overflow([&] { return over * over; });
+    ok = ok && throws_overflow([&] { return over * monomial(top / 2 + 1); });
+    for (mult_engine engine : {mult_engine::schoolbook, mult_engine::sort_reduce, mult_engine::ntt, mult_engine::fft, mult_engine::unbalanced})
+    {
+        ok = ok && throws_overflow([&] { return over.multiply(over, engine); });
+    }
+    ok = ok && throws_overflow([&] { return over.multiply(over, cache_policy::bypass); });
+
+    // a valid product spanning nearly every power: the transform engines
+    // must give up on it before building dense buffers
+    form spread = {{top / 2 * 2, 1}, {top / 2, 1}};
+    for (mult_engine engine : {mult_engine::schoolbook, mult_engine::sort_reduce, mult_engine::ntt, mult_engine::fft, mult_engine::unbalanced})
+    {
+        ok = ok && half.multiply(half + 1, engine).canonical_form() == spread;
+    }
+
+    // pow checks the degree times n once, before any work
+    polynomial third = monomial(top / 3) + 1;
+    for (pow_engine engine : {pow_engine::automatic, pow_engine::squaring})
+    {
+        ok = ok && third.pow(3, engine).canonical_form() == form{{top / 3 * 3, 1}, {top / 3 * 2, 3}, {top / 3, 3}, {0, 1}};
+    }
+    ok = ok && throws_overflow([&] { return third.pow(4); });
+    ok = ok && throws_overflow([&] { return monomial(2).pow(UINT_MAX) * monomial(top); });
+
+    // the binary format always holds 8-byte powers; a compact build rejects ones past 2^32
+    std::vector<char> bytes = monomial(5).to_binary();
+    bytes[16 + 4] = 1; // power 5 + 2^32
+    bool compact = sizeof(power) == 4;
+    ok = ok && (compact ? throws_overflow([&] { return polynomial::from_binary(bytes.data(), bytes.size()); })
+                        : polynomial::from_binary(bytes.data(), bytes.size()).canonical_form()[0].first == (uint64_t(1) << 32) + 5);
+    ok = ok && polynomial::from_binary(half.to_binary().data(), half.to_binary().size()) == half;
+
+    return ok;
+}
+
+/** a few runs of consecutive terms at random places below max_power, some straddling block edges */
+polynomial clustered_polynomial(std::mt19937 &rng, size_t clusters, size_t max_run, power max_power)
+{
+    polynomial p;
+    for (size_t i = 0; i < clusters; i++)
+    {
+        p = p + dense_polynomial(rng, 1 + rng() % max_run, rng() % max_power);
+    }
+    return p;
+}
+
+/** block_polynomial's + and * against polynomial's, and the degree check at the top power */
+bool block_test()
+{
+    std::mt19937 rng(99);
+    bool ok = true;
+    const int saved_threads = polynomial::max_threads();
+    const size_t B = block_polynomial::BLOCK_TERMS;
+
+    for (int threads : {1, 3, 8})
+    {
+        polynomial::set_max_threads(threads);
+        for (int round = 0; round < 6; round++)
+        {
+            // a lone run (one dense product on every thread) and several runs far apart
+            polynomial a = round % 3 == 0 ? dense_polynomial(rng, 1 + rng() % 3000, rng() % 1000)
+                                          : clustered_polynomial(rng, 1 + rng() % 6, 600, 1 << 20);
+            polynomial b = clustered_polynomial(rng, 1 + rng() % 4, round % 2 ? 1 : 900, 1 << 16);
+            block_polynomial x(a), y(b);
+
+            ok = ok && x.to_polynomial() == a;
+            ok = ok && (x * y).to_polynomial() == a * b && (y * x).to_polynomial() == a * b;
+            ok = ok && (x + y).to_polynomial() == a + b;
+            ok = ok && block_polynomial(a * b) == x * y;
+            for (auto &t : a.canonical_form())
+            {
+                ok = ok && x.coefficient(t.first) == t.second;
+            }
+            ok = ok && x.coefficient(a.canonical_form()[0].first + 1) == 0;
+        }
+    }
+    polynomial::set_max_threads(saved_threads);
+
+    // the zero polynomial stores nothing; cancelling sums drop their blocks
+    block_polynomial zero;
+    polynomial a = clustered_polynomial(rng, 3, 300, 5000);
+    ok = ok && block_polynomial(polynomial()) == zero && zero.block_count() == 0;
+    ok = ok && zero * block_polynomial(a) == zero && block_polynomial(a) * zero == zero;
+    ok = ok && zero + block_polynomial(a) == block_polynomial(a);
+    ok = ok && (block_polynomial(a) + block_polynomial(a * -1)) == zero;
+
+    // single terms on either side of a block edge
+    ok = ok && block_polynomial(monomial(B - 1)).block_count() == 1;
+    ok = ok && (block_polynomial(monomial(B - 1, 3)) * block_polynomial(monomial(1, 5))).to_polynomial() == monomial(B, 15);
+    ok = ok && (block_polynomial(monomial(B - 1) + monomial(B)) * block_polynomial(monomial(0, -1))).block_count() == 2;
+
+    // the degree check looks at the top term, not the end of its block
+    const power top = std::numeric_limits<power>::max();
+    ok = ok && (block_polynomial(monomial(top - 300)) * block_polynomial(monomial(5))).to_polynomial() == monomial(top - 295);
+    ok = ok && (block_polynomial(monomial(top)) * block_polynomial(monomial(0, 7))).to_polynomial() == monomial(top, 7);
+    ok = ok && throws_overflow([&] { return block_polynomial(monomial(top / 2 + 1)) * block_polynomial(monomial(top / 2 + 1)); });
+
+    return ok;
+}
+
+/** alignment, the huge-buffer pool and its limit, and large products on reused buffers */
+bool allocator_test()
+{
+    std::mt19937 rng(100);
+    bool ok = true;
+
+    for (size_t bytes : {size_t(1), size_t(63), size_t(1000), HUGE_PAGE_THRESHOLD - 1, HUGE_PAGE_THRESHOLD, HUGE_PAGE_THRESHOLD + 12345})
+    {
+        buffer<uint32_t> b(bytes / sizeof(uint32_t) + 1, 7);
+        ok = ok && reinterpret_cast<uintptr_t>(b.data()) % BUFFER_ALIGNMENT == 0 && b.back() == 7;
+    }
+
+    // a freed huge buffer stays pooled until it is taken again, released or trimmed
+    release_buffers();
+    ok = ok && pooled_buffer_bytes() == 0;
+    {
+        buffer<char> b(HUGE_PAGE_THRESHOLD);
+    }
+    size_t held = pooled_buffer_bytes();
+    ok = ok && held >= HUGE_PAGE_THRESHOLD;
+    {
+        buffer<char> b(HUGE_PAGE_THRESHOLD);
+        ok = ok && pooled_buffer_bytes() == 0;
+    }
+    ok = ok && pooled_buffer_bytes() == held;
+    polynomial::release_buffers();
+    ok = ok && pooled_buffer_bytes() == 0;
+
+    // the limit: one buffer fits, a second pushes the first out, 0 keeps nothing
+    polynomial::set_buffer_pool_limit(held);
+    {
+        buffer<char> b(HUGE_PAGE_THRESHOLD), c(HUGE_PAGE_THRESHOLD);
+    }
+    ok = ok && pooled_buffer_bytes() == held;
+    polynomial::set_buffer_pool_limit(0);
+    ok = ok && pooled_buffer_bytes() == 0;
+    {
+        buffer<char> b(2 * HUGE_PAGE_THRESHOLD);
+    }
+    ok = ok && pooled_buffer_bytes() == 0;
+
+    // transforms long enough for huge buffers give the same product on fresh
+    // mappings and on pooled ones a previous product left dirty
+    polynomial a = dense_polynomial(rng, 1100000, 0);
+    polynomial b = dense_polynomial(rng, 1000000, 3);
+    polynomial fresh = a.multiply(b, mult_engine::ntt);
+    polynomial::set_buffer_pool_limit(DEFAULT_POOL_BYTES);
+    polynomial first = a.multiply(b, mult_engine::ntt);
+    ok = ok && pooled_buffer_bytes() > 0;
+    ok = ok && first == fresh && a.multiply(b, mult_engine::ntt) == fresh;
+    ok = ok && fresh.canonical_form()[0] == std::make_pair(power(1099999 + 1000002), static_cast<coeff>(static_cast<uint32_t>(a.canonical_form()[0].second) * static_cast<uint32_t>(b.canonical_form()[0].second)));
+    polynomial::release_buffers();
+
+    return ok;
+}
+
+bool report(const char *name, bool ok)
+{
+    std::cout << (ok ? "Passed " : "Failed ") << name << " test" << std::endl;
+    return ok;
+}
+
 int main()
 {
     /** We're doing (x+1)^2, so solution is x^2 + 2x + 1*/
@@ -49,4 +1392,37 @@ int main()
     {
         std::cout << "Failed test" << std::endl;
     }
+
+    size_t failures = differential_test(200);
+    if (failures == 0)
+    {
+        std::cout << "Passed differential test" << std::endl;
+    }
+    else
+    {
+        std::cout << "Failed differential test (" << failures << " cases)" << std::endl;
+    }
+
+    report("verify", verify_test());
+    report("pow", pow_test());
+    report("warm-up", warm_up_test());
+    report("cache", cache_test());
+    report("GF(2)", gf2_test());
+    report("cyclic", wrapped_test());
+    report("sort-reduce", sort_reduce_test());
+    report("monomial", monomial_test());
+    report("unbalanced", unbalanced_test());
+    report("product tree", product_tree_test());
+    report("remainder tree", remainder_tree_test());
+    report("CRT", crt_test());
+    report("coefficient", coefficient_test());
+    report("maintained product", maintained_product_test());
+    report("online product", online_product_test());
+    report("middle product", middle_product_test());
+    report("mixed-radix NTT", mixed_radix_test());
+    report("six-step NTT", six_step_test());
+    report("FFT", fft_test());
+    report("power range", power_range_test());
+    report("block", block_test());
+    report("allocator", allocator_test());
 }
\ No newline at end of file
@@ -1,129 +1,1572 @@
 #include "poly.h"
+#include "poly_cache.h"
+#include "poly_ntt.h"
+#include "poly_fft.h"
+#include "poly_dense.h"
+#include "poly_thread.h"
 #include <iostream>
 #include <map>
 #include <stdexcept>
 #include <algorithm>
 #include <pthread.h>
 #include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <climits>
+#include <limits>
+#include <cstdlib>
+#include <random>
+#include <cmath>
 
-static void clean(std::map<power, coeff, std::greater<power>> &terms)
+// content hashing
+
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// each term hashes independently and the digests are summed, so the result
+// doesn't depend on iteration order and a single term can be added or
+// removed without rehashing the others
+static void add_term_hash(content_hash &h, power pw, coeff cf)
+{
+    uint64_t p = static_cast<uint64_t>(pw);
+    uint64_t c = static_cast<uint32_t>(cf);
+    h.lo += mix64(mix64(p + 0x9e3779b97f4a7c15ULL) ^ c);
+    h.hi += mix64(mix64(c + 0x632be59bd9b4e019ULL) ^ (p * 0xd6e8feb86659fd93ULL));
+}
+
+static void remove_term_hash(content_hash &h, power pw, coeff cf)
+{
+    content_hash term = {0, 0};
+    add_term_hash(term, pw, cf);
+    h.lo -= term.lo;
+    h.hi -= term.hi;
+}
+
+// drops zero terms and recomputes the digest in the same pass
+static void clean(std::map<power, coeff, std::greater<power>> &terms, content_hash &digest)
+{
+    digest = {0, 0};
+
+    for (auto it = terms.begin(); it != terms.end();)
+    {
+        if (it->second == 0)
+        {
+            it = terms.erase(it);
+        }
+        else
+        {
+            add_term_hash(digest, it->first, it->second);
+            it++;
+        }
+    }
+
+    if (terms.empty())
+    {
+        terms[0] = 0;  // zero polynomial
+    }
+}
+
+// result cache
+
+static std::shared_ptr<result_cache> shared_cache;
+
+static std::shared_ptr<disk_cache> shared_disk_cache;
+
+static std::shared_ptr<result_cache> active_cache()
+{
+    return std::atomic_load(&shared_cache);
+}
+
+static std::shared_ptr<disk_cache> active_disk_cache()
+{
+    return std::atomic_load(&shared_disk_cache);
+}
+
+double cache_stats::hit_rate() const
+{
+    uint64_t total = hits + misses;
+    return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+}
+
+void polynomial::enable_result_cache(size_t capacity)
+{
+    std::atomic_store(&shared_cache, std::make_shared<result_cache>(capacity));
+}
+
+void polynomial::disable_result_cache()
+{
+    std::atomic_store(&shared_cache, std::shared_ptr<result_cache>());
+}
+
+void polynomial::enable_disk_cache(const std::string &directory, size_t max_bytes, size_t min_cost)
+{
+    std::atomic_store(&shared_disk_cache, std::make_shared<disk_cache>(directory, max_bytes, min_cost));
+}
+
+void polynomial::disable_disk_cache()
+{
+    std::atomic_store(&shared_disk_cache, std::shared_ptr<disk_cache>());
+}
+
+cache_stats polynomial::result_cache_stats()
+{
+    std::shared_ptr<result_cache> cache = active_cache();
+    std::shared_ptr<disk_cache> disk = active_disk_cache();
+
+    cache_stats out = cache ? cache->stats() : cache_stats{};
+    if (disk)
+    {
+        disk->stats(out);
+    }
+    return out;
+}
+
+// The key for cache entries that only live in memory, fresh for each process.
+static const hash_key &process_hash_key()
+{
+    static const hash_key key = hash_key::random();
+    return key;
+}
+
+template <typename Terms>
+static content_hash keyed_digest(const Terms &terms, const hash_key &key)
+{
+    keyed_hasher h(key);
+    for (const auto &term : terms)
+    {
+        h.add(static_cast<uint64_t>(term.first));
+        h.add(static_cast<uint32_t>(term.second));
+    }
+    return h.finish();
+}
+
+polynomial polynomial::cached(cache_op op, const polynomial &other, cache_policy policy) const
+{
+    std::shared_ptr<result_cache> cache;
+    std::shared_ptr<disk_cache> disk;
+    if (policy == cache_policy::use)
+    {
+        cache = active_cache();
+        disk = active_disk_cache();
+    }
+
+    if (disk && !disk->worth_storing(terms.size(), other.terms.size()))
+    {
+        disk.reset();
+    }
+
+    if (!cache && !disk)
+    {
+        return op == cache_op::multiply ? multiply_uncached(other) : remainder_uncached(other);
+    }
+
+    // With a disk cache both levels share its key, so entries can move between
+    // them; memory-only entries made under the process key just stop matching.
+    const hash_key &secret = disk ? disk->secret() : process_hash_key();
+    cache_key key{op, keyed_digest(terms, secret), keyed_digest(other.terms, secret)};
+    polynomial result;
+    if (cache && cache->lookup(key, result))
+    {
+        return result;
+    }
+
+    if (disk && disk->lookup(key, result))
+    {
+        if (cache)
+        {
+            cache->insert(key, result, result.terms.size());
+        }
+        return result;
+    }
+
+    result = op == cache_op::multiply ? multiply_uncached(other) : remainder_uncached(other);
+
+    if (cache)
+    {
+        cache->insert(key, result, result.terms.size());
+    }
+    if (disk)
+    {
+        disk->insert(key, result);
+    }
+    return result;
+}
+
+// product verification
+
+static std::atomic<size_t> verify_min_terms(0);
+
+static const uint64_t VERIFY_PRIMES[2] = {(1ULL << 61) - 1, 4611686018427387847ULL}; // 2^61 - 1, 2^62 - 57
+
+static uint64_t mul_mod(uint64_t x, uint64_t y, uint64_t p)
+{
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(x) * y % p);
+}
+
+static uint64_t pow_mod(uint64_t x, uint64_t e, uint64_t p)
+{
+    uint64_t r = 1;
+    for (; e != 0; e >>= 1)
+    {
+        if (e & 1)
+        {
+            r = mul_mod(r, x, p);
+        }
+        x = mul_mod(x, x, p);
+    }
+    return r;
+}
+
+// Horner's rule over descending powers, jumping the gaps between terms
+static uint64_t evaluate_mod(const std::map<power, coeff, std::greater<power>> &terms, uint64_t x, uint64_t p)
+{
+    uint64_t acc = 0;
+    power last = terms.begin()->first;
+
+    for (auto &t : terms)
+    {
+        acc = mul_mod(acc, pow_mod(x, last - t.first, p), p);
+        uint64_t c = t.second < 0 ? p - static_cast<uint64_t>(-static_cast<int64_t>(t.second)) : static_cast<uint64_t>(t.second);
+        acc = (acc + c) % p;
+        last = t.first;
+    }
+
+    return mul_mod(acc, pow_mod(x, last, p), p);
+}
+
+void polynomial::set_product_verification(size_t min_terms)
+{
+    verify_min_terms.store(min_terms, std::memory_order_relaxed);
+}
+
+// Wrapped products are checked in the Galois ring Z/2^32[t]/(f), with f a
+// random monic degree-64 polynomial with 0/1 coefficients that is irreducible
+// mod 2. Every coeff is reduced mod 2^32 already, so c needs no fixing up, and
+// a nonzero a * b - c vanishes at t only if f mod 2 divides its odd part mod
+// 2: one of at most deg/64 irreducible factors among about 2^64/64 choices.
+static const size_t RING_DEGREE = 64;
+
+// GF(2) polynomials below degree 64 as bits, multiplied mod x^64 + low
+static uint64_t gf2_mul_mod(uint64_t x, uint64_t y, uint64_t low)
+{
+    unsigned __int128 product = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if ((y >> i) & 1)
+        {
+            product ^= static_cast<unsigned __int128>(x) << i;
+        }
+    }
+    for (int i = 127; i >= 64; i--)
+    {
+        if ((product >> i) & 1)
+        {
+            product ^= static_cast<unsigned __int128>(1) << i;
+            product ^= static_cast<unsigned __int128>(low) << (i - 64);
+        }
+    }
+    return static_cast<uint64_t>(product);
+}
+
+static int gf2_degree(unsigned __int128 x)
+{
+    int d = -1;
+    for (; x != 0; x >>= 1)
+    {
+        d++;
+    }
+    return d;
+}
+
+// Rabin's test for degree 64: x^(2^64) = x mod f, and gcd(x^(2^32) - x, f) = 1
+static bool gf2_irreducible(uint64_t low)
+{
+    uint64_t r = 2; // x
+    uint64_t half = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        r = gf2_mul_mod(r, r, low);
+        if (i == 31)
+        {
+            half = r ^ 2;
+        }
+    }
+    if (r != 2)
+    {
+        return false;
+    }
+
+    unsigned __int128 u = (static_cast<unsigned __int128>(1) << 64) | low, v = half;
+    while (v != 0)
+    {
+        while (gf2_degree(u) >= gf2_degree(v))
+        {
+            u ^= v << (gf2_degree(u) - gf2_degree(v));
+        }
+        std::swap(u, v);
+    }
+    return u == 1;
+}
+
+// terms (shifted down by `shift`) evaluated at t, by Horner's rule one power at a time
+static std::vector<uint32_t> evaluate_ring(const std::map<power, coeff, std::greater<power>> &terms, power shift, const std::vector<uint32_t> &f)
+{
+    std::vector<uint32_t> acc(RING_DEGREE, 0);
+    power last = terms.begin()->first;
+
+    for (auto &t : terms)
+    {
+        for (; last > t.first; last--)
+        {
+            // acc *= t, with t^64 = -(f_0 + f_1 t + ... + f_63 t^63)
+            uint32_t top = acc[RING_DEGREE - 1];
+            for (size_t i = RING_DEGREE - 1; i > 0; i--)
+            {
+                acc[i] = acc[i - 1] - top * f[i];
+            }
+            acc[0] = 0u - top * f[0];
+        }
+        acc[0] += static_cast<uint32_t>(t.second);
+    }
+    for (; last > shift; last--)
+    {
+        uint32_t top = acc[RING_DEGREE - 1];
+        for (size_t i = RING_DEGREE - 1; i > 0; i--)
+        {
+            acc[i] = acc[i - 1] - top * f[i];
+        }
+        acc[0] = 0u - top * f[0];
+    }
+
+    return acc;
+}
+
+static std::vector<uint32_t> ring_multiply(const std::vector<uint32_t> &x, const std::vector<uint32_t> &y, const std::vector<uint32_t> &f)
+{
+    std::vector<uint32_t> r(2 * RING_DEGREE - 1, 0);
+    for (size_t i = 0; i < RING_DEGREE; i++)
+    {
+        for (size_t j = 0; j < RING_DEGREE; j++)
+        {
+            r[i + j] += x[i] * y[j];
+        }
+    }
+    for (size_t i = r.size() - 1; i >= RING_DEGREE; i--)
+    {
+        for (size_t j = 0; j < RING_DEGREE; j++)
+        {
+            r[i - RING_DEGREE + j] -= r[i] * f[j];
+        }
+    }
+    r.resize(RING_DEGREE);
+    return r;
+}
+
+bool verify_product(const polynomial &a, const polynomial &b, const polynomial &c)
+{
+    // bound every coefficient of a * b by min(|a|_1 * max|b|, |b|_1 * max|a|)
+    unsigned __int128 sum_a = 0, sum_b = 0, max_a = 0, max_b = 0;
+    for (auto &t : a.terms)
+    {
+        unsigned __int128 v = static_cast<unsigned __int128>(std::abs(static_cast<int64_t>(t.second)));
+        sum_a += v;
+        max_a = std::max(max_a, v);
+    }
+    for (auto &t : b.terms)
+    {
+        unsigned __int128 v = static_cast<unsigned __int128>(std::abs(static_cast<int64_t>(t.second)));
+        sum_b += v;
+        max_b = std::max(max_b, v);
+    }
+
+    static thread_local std::mt19937_64 rng(std::random_device{}());
+
+    if (std::min(sum_a * max_b, sum_b * max_a) <= static_cast<unsigned __int128>(INT_MAX))
+    {
+        // nothing wraps, so the product holds over the integers and mod any prime
+        for (uint64_t p : VERIFY_PRIMES)
+        {
+            uint64_t x = 2 + rng() % (p - 3);
+            if (mul_mod(evaluate_mod(a.terms, x, p), evaluate_mod(b.terms, x, p), p) != evaluate_mod(c.terms, x, p))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the product can't have terms outside [low_a + low_b, high_a + high_b]
+    power low_a = a.terms.rbegin()->first, low_b = b.terms.rbegin()->first;
+    power high = a.terms.begin()->first + b.terms.begin()->first;
+    bool zero = c.terms.size() == 1 && c.terms.begin()->second == 0;
+    if (!zero && (c.terms.rbegin()->first < low_a + low_b || c.terms.begin()->first > high))
+    {
+        return false;
+    }
+
+    // Horner's rule steps through every power of the span, 64 operations each;
+    // past the cost of the term products themselves, recomputing is cheaper
+    double steps = static_cast<double>(high - low_a - low_b + 1) * 2;
+    if (steps * RING_DEGREE > static_cast<double>(a.terms.size()) * static_cast<double>(b.terms.size()))
+    {
+        return a.multiply_schoolbook(b) == c;
+    }
+
+    uint64_t low;
+    do
+    {
+        low = rng() | 1; // a constant term of 0 would make x a factor
+    } while (!gf2_irreducible(low));
+
+    std::vector<uint32_t> f(RING_DEGREE);
+    for (size_t i = 0; i < RING_DEGREE; i++)
+    {
+        f[i] = (low >> i) & 1;
+    }
+
+    std::vector<uint32_t> ab = ring_multiply(evaluate_ring(a.terms, low_a, f), evaluate_ring(b.terms, low_b, f), f);
+    if (zero)
+    {
+        return ab == std::vector<uint32_t>(RING_DEGREE, 0);
+    }
+    return ab == evaluate_ring(c.terms, low_a + low_b, f);
+}
+
+// parallel multiplication helpers
+
+struct multiplication
+{
+    const std::vector<std::pair<power, coeff>> *a;
+    const std::vector<std::pair<power, coeff>> *b;
+
+    size_t start;
+    size_t end;
+
+    std::unordered_map<power, coeff> *partial;
+};
+
+static void *multiply(void *arg)
+{
+    multiplication *task = static_cast<multiplication*>(arg);
+    const auto &a = *(task->a);
+    const auto &b = *(task->b);
+    auto &x = *(task->partial);
+
+    for (size_t i = task->start; i < task->end; i++)
+    {
+        const auto &at = a[i];
+        for (const auto &bt : b)
+        {
+            power p = at.first + bt.first;
+            coeff c = at.second * bt.second;
+            x[p] += c;
+        }
+    }
+
+    return nullptr;
+}
+
+// the product's top power is the sum of the operands' top powers; every
+// other power summed by a multiplication engine is below it
+static void check_product_degree(const std::map<power, coeff, std::greater<power>> &a, const std::map<power, coeff, std::greater<power>> &b)
+{
+    if (a.begin()->first > std::numeric_limits<power>::max() - b.begin()->first)
+    {
+        throw std::overflow_error("product degree out of range");
+    }
+}
+
+// polynomial member functions
+
+polynomial::polynomial()
+    : digest{0, 0}
+{
+    terms[0] = 0;
+}
+
+polynomial::polynomial(const polynomial &other)
+{
+    terms = other.terms;
+    digest = other.digest;
+}
+
+polynomial &polynomial::operator=(const polynomial &other)
+{
+    if (this != &other)
+    {
+        terms = other.terms;
+        digest = other.digest;
+    }
+    return *this;
+}
+
+content_hash polynomial::hash() const
+{
+    return digest;
+}
+
+bool polynomial::operator==(const polynomial &other) const
+{
+    if (digest.lo != other.digest.lo || digest.hi != other.digest.hi)
+    {
+        return false;
+    }
+
+    if (terms.size() != other.terms.size() || terms.begin()->first != other.terms.begin()->first)
+    {
+        return false;
+    }
+
+    return terms == other.terms;
+}
+
+bool polynomial::operator!=(const polynomial &other) const
+{
+    return !(*this == other);
+}
+
+template <typename Iter>
+polynomial::polynomial(Iter begin, Iter end)
+{
+    for (auto it = begin; it != end; it++)
+    {
+        if (it->first > std::numeric_limits<power>::max())
+        {
+            throw std::overflow_error("power out of range");
+        }
+        terms[static_cast<power>(it->first)] += it->second;
+    }
+    clean(terms, digest);
+}
+
+template polynomial::polynomial(std::vector<std::pair<power, coeff>>::iterator, std::vector<std::pair<power, coeff>>::iterator);
+
+polynomial polynomial::operator+(const polynomial &other) const
+{
+    polynomial result(*this);
+
+    for (auto &t : other.terms)
+    {
+        result.terms[t.first] += t.second;
+    }
+    
+    clean(result.terms, result.digest);
+    return result;
+}
+
+polynomial &polynomial::operator+=(const polynomial &other)
+{
+    if (this == &other)
+    {
+        // the loop below erases terms that cancel, which would pull them out
+        // from under the iteration over other
+        polynomial copy(other);
+        return *this += copy;
+    }
+
+    if (terms.size() == 1 && terms.begin()->second == 0)
+    {
+        terms.clear(); // zero polynomial
+    }
+
+    // a few terms are looked up one by one; many are merged in a single
+    // pass, walking both maps from the top power down
+    bool merge = other.terms.size() * 16 >= terms.size();
+    auto it = terms.begin();
+
+    for (auto &t : other.terms)
+    {
+        if (t.second == 0)
+        {
+            continue;
+        }
+
+        if (merge)
+        {
+            while (it != terms.end() && it->first > t.first)
+            {
+                it++;
+            }
+        }
+        else
+        {
+            it = terms.lower_bound(t.first);
+        }
+
+        uint32_t sum = static_cast<uint32_t>(t.second);
+        if (it != terms.end() && it->first == t.first)
+        {
+            remove_term_hash(digest, it->first, it->second);
+            sum += static_cast<uint32_t>(it->second);
+
+            if (sum == 0)
+            {
+                it = terms.erase(it);
+                continue;
+            }
+            it->second = static_cast<coeff>(sum);
+        }
+        else
+        {
+            it = terms.emplace_hint(it, t.first, static_cast<coeff>(sum));
+        }
+        add_term_hash(digest, t.first, static_cast<coeff>(sum));
+    }
+
+    if (terms.empty())
+    {
+        terms[0] = 0;
+    }
+    return *this;
+}
+
+polynomial polynomial::operator+(int x) const
+{
+    polynomial result(*this);
+
+    result.terms[0] += x;
+    clean(result.terms, result.digest);
+
+    return result;
+}
+
+polynomial operator+(int x, const polynomial &p)
+{
+    return p + x;
+}
+
+polynomial polynomial::operator*(const polynomial &other) const
+{
+    return multiply(other, cache_policy::use);
+}
+
+polynomial polynomial::multiply(const polynomial &other, cache_policy policy) const
+{
+    check_product_degree(terms, other.terms);
+    polynomial result = cached(cache_op::multiply, other, policy);
+
+    size_t min_terms = verify_min_terms.load(std::memory_order_relaxed);
+    if (min_terms != 0 && terms.size() + other.terms.size() >= min_terms && !verify_product(*this, other, result))
+    {
+        throw std::runtime_error("product verification failed");
+    }
+
+    return result;
+}
+
+// dense conversions
+
+// relative cost of one transform element-step against one schoolbook term product
+static const double NTT_COST = 8.0;
+
+// term products above which sorting flat buffers beats hash map partials
+static const double SORT_REDUCE_PRODUCTS = 1 << 16;
+
+// one operand at least this many times longer than the other counts as unbalanced
+static const size_t UNBALANCED_RATIO = 8;
+static const double UNBALANCED_PRODUCTS = 1 << 14;
+
+// long-division work (quotient length times divisor terms) above which a
+// unit-leading-coefficient remainder switches to Newton iteration
+static const size_t FAST_REMAINDER_STEPS = 1 << 12;
+
+// the highest sparse dividend degree spread out densely for that, unless it is dense anyway
+static const size_t FAST_REMAINDER_SPAN = 1 << 20;
+
+// the smallest operand worth converting to dense coefficients
+static const size_t DENSE_MIN_TERMS = 16;
+
+static size_t dense_span(const std::map<power, coeff, std::greater<power>> &terms)
+{
+    return terms.begin()->first - terms.rbegin()->first + 1;
+}
+
+// the product's span fits a transform; checked on the powers, before any dense buffer
+static bool transform_fits(const std::map<power, coeff, std::greater<power>> &a, const std::map<power, coeff, std::greater<power>> &b)
+{
+    size_t width_a = a.begin()->first - a.rbegin()->first;
+    size_t width_b = b.begin()->first - b.rbegin()->first;
+    return width_a < NTT_MAX_LENGTH && width_b < NTT_MAX_LENGTH && ntt_length(width_a + width_b + 1) != 0;
+}
+
+// at least one term in eight of the span is nonzero
+static bool dense_enough(const std::map<power, coeff, std::greater<power>> &terms)
+{
+    return terms.size() * 8 >= dense_span(terms);
+}
+
+// the coefficients from the lowest power up; low receives that power
+static dense_coeffs to_dense(const std::map<power, coeff, std::greater<power>> &terms, power &low)
+{
+    low = terms.rbegin()->first;
+    dense_coeffs out(dense_span(terms), 0);
+
+    for (auto &t : terms)
+    {
+        out[t.first - low] = static_cast<uint32_t>(t.second);
+    }
+    return out;
+}
+
+// reduces the terms into n coefficients mod x^n - 1, or mod x^n + 1
+static dense_coeffs fold_dense(const std::map<power, coeff, std::greater<power>> &terms, size_t n, bool negacyclic)
+{
+    dense_coeffs out(n, 0);
+
+    for (auto &t : terms)
+    {
+        uint32_t v = static_cast<uint32_t>(t.second);
+        if (negacyclic && (t.first / n) % 2 == 1)
+        {
+            v = 0u - v;
+        }
+        out[t.first % n] += v;
+    }
+    return out;
+}
+
+// replaces terms with c[i] x^(i + shift), skipping zeros; the caller cleans
+static void from_dense(const dense_coeffs &c, power shift, std::map<power, coeff, std::greater<power>> &terms)
+{
+    terms.clear();
+
+    for (size_t i = c.size(); i-- > 0;)
+    {
+        if (c[i] != 0)
+        {
+            terms.emplace_hint(terms.end(), i + shift, static_cast<coeff>(c[i]));
+        }
+    }
+}
+
+// engine selection
+
+static std::atomic<int> thread_limit(8);
+
+void polynomial::set_max_threads(int threads)
+{
+    thread_limit.store(std::max(1, threads), std::memory_order_relaxed);
+    set_buffer_fault_threads(threads);
+}
+
+int polynomial::max_threads()
+{
+    // already one of several parallel tasks: don't fan out again
+    return in_parallel_task() ? 1 : thread_limit.load(std::memory_order_relaxed);
+}
+
+void polynomial::set_six_step_cutoff(size_t length)
+{
+    set_ntt_six_step_cutoff(length);
+}
+
+void polynomial::warm_up(size_t max_terms)
+{
+    ntt_warm_up(max_terms);
+    fft_warm_up(max_terms);
+}
+
+void polynomial::set_buffer_pool_limit(size_t bytes)
+{
+    ::set_buffer_pool_limit(bytes);
+}
+
+void polynomial::release_buffers()
+{
+    ::release_buffers();
+}
+
+std::vector<mult_engine> polynomial::engines()
+{
+    return {mult_engine::schoolbook, mult_engine::ntt, mult_engine::sort_reduce, mult_engine::karatsuba, mult_engine::unbalanced, mult_engine::fft};
+}
+
+polynomial polynomial::multiply(const polynomial &other, mult_engine engine) const
+{
+    check_product_degree(terms, other.terms);
+    switch (engine)
+    {
+    case mult_engine::schoolbook:
+        return multiply_schoolbook(other);
+    case mult_engine::ntt:
+        return multiply_ntt(other);
+    case mult_engine::sort_reduce:
+        return multiply_sort_reduce(other);
+    case mult_engine::karatsuba:
+        return multiply_karatsuba(other);
+    case mult_engine::unbalanced:
+        return multiply_unbalanced(other);
+    case mult_engine::fft:
+        return multiply_fft(other);
+    case mult_engine::automatic:
+        break;
+    }
+
+    return multiply_uncached(other);
+}
+
+polynomial polynomial::multiply_uncached(const polynomial &other) const
+{
+    if (other.terms.size() == 1)
+    {
+        return multiply_monomial(other.terms.begin()->first, other.terms.begin()->second);
+    }
+    if (terms.size() == 1)
+    {
+        return other.multiply_monomial(terms.begin()->first, terms.begin()->second);
+    }
+
+    double products = static_cast<double>(terms.size()) * static_cast<double>(other.terms.size());
+    size_t shorter = std::min(terms.size(), other.terms.size());
+    size_t longer = std::max(terms.size(), other.terms.size());
+
+    if (longer >= UNBALANCED_RATIO * shorter && products >= UNBALANCED_PRODUCTS)
+    {
+        return multiply_unbalanced(other);
+    }
+
+    if (dense_enough(terms) && dense_enough(other.terms) && shorter >= DENSE_MIN_TERMS)
+    {
+        return multiply_dense(other);
+    }
+
+    // a transform pays off once the term products clearly outnumber the
+    // transform work over the dense span of the result
+    size_t length = dense_span(terms) + dense_span(other.terms) - 1;
+    size_t n = ntt_length(length);
+    if (n != 0)
+    {
+        double transform = NTT_COST * static_cast<double>(n) * std::log2(static_cast<double>(n) + 1);
+        if (products > transform)
+        {
+            return multiply_fft(other);
+        }
+    }
+
+    if (products >= SORT_REDUCE_PRODUCTS)
+    {
+        return multiply_sort_reduce(other);
+    }
+
+    return multiply_schoolbook(other);
+}
+
+// unbalanced operands
+
+polynomial polynomial::multiply_unbalanced(const polynomial &other) const
+{
+    const polynomial &small = terms.size() <= other.terms.size() ? *this : other;
+    const polynomial &large = terms.size() <= other.terms.size() ? other : *this;
+    const int threads = max_threads();
+
+    polynomial result;
+
+    if (dense_enough(small.terms) && dense_enough(large.terms))
+    {
+        power low_s, low_l;
+        dense_coeffs s = to_dense(small.terms, low_s);
+        dense_coeffs l = to_dense(large.terms, low_l);
+
+        size_t m = s.size();
+        size_t blocks = (l.size() + m - 1) / m;
+        dense_coeffs c(l.size() + m - 1, 0);
+
+        // block k's product covers [k m, k m + 2m - 1), so blocks of the same
+        // parity never overlap and each round can add in place
+        for (size_t parity = 0; parity < 2; parity++)
+        {
+            parallel_for((blocks + 1 - parity) / 2, threads, [&](size_t k)
+            {
+                size_t start = (2 * k + parity) * m;
+                dense_coeffs block(l.begin() + start, l.begin() + std::min(start + m, l.size()));
+                dense_coeffs p = dense_multiply(block, s, 1);
+
+                for (size_t i = 0; i < p.size(); i++)
+                {
+                    c[start + i] += p[i];
+                }
+            });
+        }
+
+        from_dense(c, low_s + low_l, result.terms);
+        clean(result.terms, result.digest);
+        return result;
+    }
+
+    // sparse: chunks of the large operand's terms, each reduced to a sorted run
+    std::vector<std::pair<power, coeff>> s(small.terms.begin(), small.terms.end());
+    std::vector<std::pair<power, coeff>> l(large.terms.begin(), large.terms.end());
+
+    size_t m = std::max<size_t>(s.size(), 64);
+    size_t chunks = (l.size() + m - 1) / m;
+    std::vector<std::vector<std::pair<power, uint32_t>>> runs(chunks);
+
+    parallel_for(chunks, threads, [&](size_t k)
+    {
+        std::vector<std::pair<power, uint32_t>> products;
+        products.reserve(std::min(m, l.size() - k * m) * s.size());
+
+        for (size_t i = k * m; i < std::min(l.size(), (k + 1) * m); i++)
+        {
+            for (const auto &st : s)
+            {
+                products.push_back({l[i].first + st.first, static_cast<uint32_t>(l[i].second) * static_cast<uint32_t>(st.second)});
+            }
+        }
+
+        std::sort(products.begin(), products.end(), [](const std::pair<power, uint32_t> &x, const std::pair<power, uint32_t> &y) { return x.first > y.first; });
+
+        auto &run = runs[k];
+        for (const auto &pt : products)
+        {
+            if (!run.empty() && run.back().first == pt.first)
+            {
+                run.back().second += pt.second;
+            }
+            else
+            {
+                run.push_back(pt);
+            }
+        }
+    });
+
+    // overlap-add the runs; each is already in descending power order
+    std::map<power, uint32_t, std::greater<power>> sums;
+    for (const auto &run : runs)
+    {
+        auto hint = sums.begin();
+        for (const auto &pt : run)
+        {
+            hint = sums.emplace_hint(hint, pt.first, 0);
+            hint->second += pt.second;
+        }
+    }
+
+    result.terms.clear();
+    for (const auto &t : sums)
+    {
+        result.terms.emplace_hint(result.terms.end(), t.first, static_cast<coeff>(t.second));
+    }
+
+    clean(result.terms, result.digest);
+    return result;
+}
+
+// monomial kernel
+
+// p[i] += k and v[i] *= c over contiguous arrays; a plain loop the compiler vectorizes
+static void shift_scale(power *p, uint32_t *v, size_t n, power k, uint32_t c)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        p[i] += k;
+        v[i] *= c;
+    }
+}
+
+polynomial polynomial::multiply_monomial(power k, coeff c) const
+{
+    std::vector<power> powers;
+    std::vector<uint32_t> values;
+    powers.reserve(terms.size());
+    values.reserve(terms.size());
+
+    for (auto &t : terms)
+    {
+        powers.push_back(t.first);
+        values.push_back(static_cast<uint32_t>(t.second));
+    }
+
+    shift_scale(powers.data(), values.data(), powers.size(), k, static_cast<uint32_t>(c));
+
+    // shifting keeps the order, so every term goes at the end of the map
+    polynomial result;
+    result.terms.clear();
+    for (size_t i = 0; i < powers.size(); i++)
+    {
+        if (values[i] != 0)
+        {
+            result.terms.emplace_hint(result.terms.end(), powers[i], static_cast<coeff>(values[i]));
+        }
+    }
+
+    clean(result.terms, result.digest);
+    return result;
+}
+
+// sort-and-reduce engine
+
+// stable parallel LSD radix sort of (key, value) pairs on the low `bits` key bits
+static void radix_sort(buffer<power> &keys, buffer<uint32_t> &values, int bits, int threads)
+{
+    const int RADIX_BITS = 8;
+    const size_t BUCKETS = size_t(1) << RADIX_BITS;
+
+    size_t n = keys.size();
+    size_t parts = std::max<size_t>(1, std::min<size_t>(threads, n / 4096));
+    size_t chunk = (n + parts - 1) / parts;
+
+    buffer<power> key_buf(n);
+    buffer<uint32_t> value_buf(n);
+    std::vector<size_t> offsets(parts * BUCKETS);
+
+    for (int shift = 0; shift < bits; shift += RADIX_BITS)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+
+        parallel_for(parts, threads, [&](size_t t)
+        {
+            size_t *count = &offsets[t * BUCKETS];
+            for (size_t i = t * chunk; i < std::min(n, (t + 1) * chunk); i++)
+            {
+                count[(keys[i] >> shift) & (BUCKETS - 1)]++;
+            }
+        });
+
+        // each part writes its share of a bucket after the earlier parts' shares
+        size_t sum = 0;
+        for (size_t d = 0; d < BUCKETS; d++)
+        {
+            for (size_t t = 0; t < parts; t++)
+            {
+                size_t c = offsets[t * BUCKETS + d];
+                offsets[t * BUCKETS + d] = sum;
+                sum += c;
+            }
+        }
+
+        parallel_for(parts, threads, [&](size_t t)
+        {
+            size_t *next = &offsets[t * BUCKETS];
+            for (size_t i = t * chunk; i < std::min(n, (t + 1) * chunk); i++)
+            {
+                size_t pos = next[(keys[i] >> shift) & (BUCKETS - 1)]++;
+                key_buf[pos] = keys[i];
+                value_buf[pos] = values[i];
+            }
+        });
+
+        keys.swap(key_buf);
+        values.swap(value_buf);
+    }
+}
+
+polynomial polynomial::multiply_sort_reduce(const polynomial &other) const
+{
+    std::vector<std::pair<power, coeff>> a(terms.begin(), terms.end());
+    std::vector<std::pair<power, coeff>> b(other.terms.begin(), other.terms.end());
+
+    const int threads = max_threads();
+    const size_t n = a.size() * b.size();
+
+    // keys are offsets from the lowest possible power, to keep the sort short
+    const power low = a.back().first + b.back().first;
+    const power high = a.front().first + b.front().first;
+    int bits = 0;
+    while (bits < std::numeric_limits<power>::digits && ((high - low) >> bits) != 0)
+    {
+        bits++;
+    }
+
+    // every row of a owns a fixed slice of the buffers, so writers never meet
+    buffer<power> keys(n);
+    buffer<uint32_t> values(n);
+
+    parallel_for(a.size(), threads, [&](size_t i)
+    {
+        size_t out = i * b.size();
+        for (const auto &bt : b)
+        {
+            keys[out] = a[i].first + bt.first - low;
+            values[out] = static_cast<uint32_t>(a[i].second) * static_cast<uint32_t>(bt.second);
+            out++;
+        }
+    });
+
+    radix_sort(keys, values, bits, threads);
+
+    // segmented reduction: parts start on key boundaries, so each sums whole runs
+    size_t parts = std::max<size_t>(1, std::min<size_t>(threads, n / 4096));
+    std::vector<size_t> starts(parts + 1, n);
+    starts[0] = 0;
+    for (size_t t = 1; t < parts; t++)
+    {
+        size_t s = std::max(starts[t - 1], t * n / parts);
+        while (s < n && s > 0 && keys[s] == keys[s - 1])
+        {
+            s++;
+        }
+        starts[t] = s;
+    }
+
+    std::vector<std::vector<std::pair<power, uint32_t>>> sums(parts);
+    parallel_for(parts, threads, [&](size_t t)
+    {
+        for (size_t i = starts[t]; i < starts[t + 1];)
+        {
+            power key = keys[i];
+            uint32_t sum = 0;
+            for (; i < starts[t + 1] && keys[i] == key; i++)
+            {
+                sum += values[i];
+            }
+            if (sum != 0)
+            {
+                sums[t].push_back({key + low, sum});
+            }
+        }
+    });
+
+    // runs come out in ascending power order, the map wants descending
+    polynomial result;
+    result.terms.clear();
+    for (size_t t = parts; t-- > 0;)
+    {
+        for (size_t i = sums[t].size(); i-- > 0;)
+        {
+            result.terms.emplace_hint(result.terms.end(), sums[t][i].first, static_cast<coeff>(sums[t][i].second));
+        }
+    }
+
+    clean(result.terms, result.digest);
+    return result;
+}
+
+// dense engines
+
+polynomial polynomial::multiply_karatsuba(const polynomial &other) const
+{
+    power low_a, low_b;
+    dense_coeffs a = to_dense(terms, low_a);
+    dense_coeffs b = to_dense(other.terms, low_b);
+
+    polynomial result;
+    from_dense(karatsuba_multiply(a, b), low_a + low_b, result.terms);
+    clean(result.terms, result.digest);
+    return result;
+}
+
+polynomial polynomial::multiply_dense(const polynomial &other) const
+{
+    power low_a, low_b;
+    dense_coeffs a = to_dense(terms, low_a);
+    dense_coeffs b = to_dense(other.terms, low_b);
+
+    polynomial result;
+    from_dense(dense_multiply(a, b, max_threads()), low_a + low_b, result.terms);
+    clean(result.terms, result.digest);
+    return result;
+}
+
+polynomial polynomial::multiply_ntt(const polynomial &other) const
+{
+    if (!transform_fits(terms, other.terms))
+    {
+        return multiply_schoolbook(other); // too long for the NTT primes
+    }
+
+    power low_a, low_b;
+    dense_coeffs a = to_dense(terms, low_a);
+    dense_coeffs b = to_dense(other.terms, low_b);
+
+    polynomial result;
+    from_dense(ntt_multiply(a, b, max_threads()), low_a + low_b, result.terms);
+    clean(result.terms, result.digest);
+    return result;
+}
+
+polynomial polynomial::multiply_fft(const polynomial &other) const
 {
-    for (auto it = terms.begin(); it != terms.end();)
+    if (!transform_fits(terms, other.terms))
     {
-        if (it->second == 0)
-        {
-            it = terms.erase(it);
-        }
-        else
-        {
-            it++;
-        }
+        return multiply_schoolbook(other);
     }
 
-    if (terms.empty())
+    power low_a, low_b;
+    dense_coeffs a = to_dense(terms, low_a);
+    dense_coeffs b = to_dense(other.terms, low_b);
+
+    polynomial result;
+    dense_coeffs product;
+    if (!fft_multiply(a, b, max_threads(), product))
     {
-        terms[0] = 0;  // zero polynomial
+        return multiply_ntt(other); // rounding could go wrong, or too long
     }
-}
 
-// parallel multiplication helpers
+    from_dense(product, low_a + low_b, result.terms);
+    clean(result.terms, result.digest);
+    return result;
+}
 
-struct multiplication
+polynomial polynomial::multiply_cyclic(const polynomial &other, size_t n) const
 {
-    const std::vector<std::pair<power, coeff>> *a;
-    const std::vector<std::pair<power, coeff>> *b;
-
-    size_t start;
-    size_t end;
+    return multiply_wrapped(other, n, false);
+}
 
-    std::unordered_map<power, coeff> *partial;
-};
+polynomial polynomial::multiply_negacyclic(const polynomial &other, size_t n) const
+{
+    return multiply_wrapped(other, n, true);
+}
 
-static void *multiply(void *arg)
+polynomial polynomial::multiply_wrapped(const polynomial &other, size_t n, bool negacyclic) const
 {
-    multiplication *task = static_cast<multiplication*>(arg);
-    const auto &a = *(task->a);
-    const auto &b = *(task->b);
-    auto &x = *(task->partial);
+    if (n == 0)
+    {
+        throw std::runtime_error("error");
+    }
 
-    for (size_t i = task->start; i < task->end; i++)
+    dense_coeffs a = fold_dense(terms, n, negacyclic);
+    dense_coeffs b = fold_dense(other.terms, n, negacyclic);
+    dense_coeffs c;
+
+    if (ntt_cyclic_supported(n, negacyclic))
     {
-        const auto &at = a[i];
-        for (const auto &bt : b)
+        c = ntt_multiply_cyclic(a, b, negacyclic, max_threads());
+    }
+    else
+    {
+        // direct wrap-around over the nonzero folded terms
+        std::vector<std::pair<size_t, uint32_t>> sa, sb;
+        for (size_t i = 0; i < n; i++)
         {
-            power p = at.first + bt.first;
-            coeff c = at.second * bt.second;
-            x[p] += c;
+            if (a[i] != 0)
+            {
+                sa.push_back({i, a[i]});
+            }
+            if (b[i] != 0)
+            {
+                sb.push_back({i, b[i]});
+            }
+        }
+
+        c.assign(n, 0);
+        for (auto &at : sa)
+        {
+            for (auto &bt : sb)
+            {
+                size_t p = at.first + bt.first;
+                uint32_t v = at.second * bt.second;
+                if (p >= n)
+                {
+                    p -= n;
+                    v = negacyclic ? 0u - v : v;
+                }
+                c[p] += v;
+            }
         }
     }
 
-    return nullptr;
+    polynomial result;
+    from_dense(c, 0, result.terms);
+    clean(result.terms, result.digest);
+    return result;
 }
 
-// polynomial member functions
+// coefficient extraction
 
-polynomial::polynomial()
-{
-    terms[0] = 0;
-}
+// output coefficients per parallel task of a windowed product
+static const size_t WINDOW_BLOCK = 1 << 10;
 
-polynomial::polynomial(const polynomial &other)
+coeff polynomial::coefficient(power k) const
 {
-    terms = other.terms;
+    auto it = terms.find(k);
+    return it == terms.end() ? 0 : it->second;
 }
 
-polynomial &polynomial::operator=(const polynomial &other)
+coeff coefficient_of_product(const polynomial &a, const polynomial &b, power k)
 {
-    if (this != &other)
+    uint32_t sum = 0;
+    auto bt = b.terms.rbegin();
+
+    // a's powers fall as b's partners k - i rise
+    for (auto &at : a.terms)
     {
-        terms = other.terms;
+        if (at.first > k)
+        {
+            continue;
+        }
+
+        power want = k - at.first;
+        while (bt != b.terms.rend() && bt->first < want)
+        {
+            bt++;
+        }
+        if (bt == b.terms.rend())
+        {
+            break;
+        }
+        if (bt->first == want)
+        {
+            sum += static_cast<uint32_t>(at.second) * static_cast<uint32_t>(bt->second);
+        }
     }
-    return *this;
+
+    return static_cast<coeff>(sum);
 }
 
-template <typename Iter>
-polynomial::polynomial(Iter begin, Iter end)
+std::vector<coeff> coefficients_of_product(const polynomial &a, const polynomial &b, power low, power high)
 {
-    for (auto it = begin; it != end; it++)
+    if (low > high)
+    {
+        throw std::runtime_error("error");
+    }
+
+    // nothing above the product's top power can be nonzero; clamping there
+    // also keeps high - low + 1 from wrapping for a window up to the largest power
+    power a_top = a.terms.begin()->first, b_top = b.terms.begin()->first;
+    power top = a_top > std::numeric_limits<power>::max() - b_top ? std::numeric_limits<power>::max() : a_top + b_top;
+    high = std::min(high, top);
+    if (low > high)
+    {
+        return {};
+    }
+
+    size_t width = static_cast<size_t>(high - low) + 1;
+    std::vector<uint32_t> out(width, 0);
+    size_t blocks = (width + WINDOW_BLOCK - 1) / WINDOW_BLOCK;
+    int threads = blocks > 1 ? polynomial::max_threads() : 1;
+
+    if (dense_enough(a.terms) && dense_enough(b.terms))
+    {
+        power la, lb;
+        dense_coeffs da = to_dense(a.terms, la);
+        dense_coeffs db = to_dense(b.terms, lb);
+        power ha = la + da.size() - 1, hb = lb + db.size() - 1;
+
+        parallel_for(blocks, threads, [&](size_t block)
+        {
+            size_t end = std::min(width, (block + 1) * WINDOW_BLOCK);
+            for (size_t j = block * WINDOW_BLOCK; j < end; j++)
+            {
+                // x^(low + j) pairs a's x^i with b's x^(low + j - i)
+                power k = low + j;
+                if (k < la + lb || k > ha + hb)
+                {
+                    continue;
+                }
+
+                power from = std::max(la, k - std::min(k, hb));
+                power to = std::min(ha, k - lb);
+                // offsets into da, so the loop can't wrap when to is the largest power
+                uint32_t sum = 0;
+                for (size_t i = from - la; i <= to - la; i++)
+                {
+                    sum += da[i] * db[k - lb - la - i];
+                }
+                out[j] = sum;
+            }
+        });
+    }
+    else
     {
-        terms[it->first] += it->second;
+        parallel_for(blocks, threads, [&](size_t block)
+        {
+            power lo = low + block * WINDOW_BLOCK;
+            power hi = low + std::min(width, (block + 1) * WINDOW_BLOCK) - 1;
+
+            for (auto &at : a.terms)
+            {
+                if (at.first > hi)
+                {
+                    continue;
+                }
+
+                // b's terms with power in [lo - i, hi - i], walked downwards
+                power from = lo > at.first ? lo - at.first : 0;
+                for (auto bt = b.terms.lower_bound(hi - at.first); bt != b.terms.end() && bt->first >= from; bt++)
+                {
+                    out[at.first + bt->first - low] += static_cast<uint32_t>(at.second) * static_cast<uint32_t>(bt->second);
+                }
+            }
+        });
     }
-    clean(terms);
+
+    return std::vector<coeff>(out.begin(), out.end());
 }
 
-template polynomial::polynomial(std::vector<std::pair<power, coeff>>::iterator, std::vector<std::pair<power, coeff>>::iterator);
+// powers
 
-polynomial polynomial::operator+(const polynomial &other) const
-{
-    polynomial result(*this);
+// the highest base degree (past its lowest power) pow() runs the recurrence on
+static const size_t MILLER_MAX_DEGREE = 32;
 
-    for (auto &t : other.terms)
+// the base divided by x^low, as exact integers from the lowest power up
+static std::vector<int64_t> shifted_coeffs(const std::map<power, coeff, std::greater<power>> &terms, power &low)
+{
+    low = terms.rbegin()->first;
+    std::vector<int64_t> h(terms.begin()->first - low + 1, 0);
+    for (auto &t : terms)
     {
-        result.terms[t.first] += t.second;
+        h[t.first - low] = t.second;
     }
-    
-    clean(result.terms);
-    return result;
+    return h;
 }
 
-polynomial polynomial::operator+(int x) const
+// every g_k of h^n is at most L^n with L = |h|_1, and every step sum adds d
+// terms below (n + 1) d max|h_i| L^n <= (n + 1) d L^(n + 1); all of that has
+// to stay clear of the __int128 range
+static bool miller_fits(const std::vector<int64_t> &h, unsigned int n)
 {
-    polynomial result(*this);
+    const unsigned __int128 limit = static_cast<unsigned __int128>(1) << 125;
 
-    result.terms[0] += x;
-    clean(result.terms);
+    unsigned __int128 l1 = 0;
+    for (int64_t c : h)
+    {
+        l1 += static_cast<uint64_t>(c < 0 ? -c : c);
+    }
+
+    size_t d = h.size() - 1;
+    unsigned __int128 bound = static_cast<unsigned __int128>(uint64_t(n) + 1) * (d + 1) * (d + 1);
+    if (l1 <= 1)
+    {
+        return bound <= limit; // l1^(n+1) stays 1
+    }
+
+    // l1 >= 2, so this gives up within 125 rounds
+    for (uint64_t i = 0; i <= n; i++)
+    {
+        if (bound > limit / l1)
+        {
+            return false;
+        }
+        bound *= l1;
+    }
+    return true;
+}
 
+// base^n by repeated squaring; the caller makes sure it fits
+static __int128 power_of(int64_t base, unsigned int n)
+{
+    __int128 result = 1;
+    __int128 square = base;
+    for (; n != 0; n >>= 1)
+    {
+        if (n & 1)
+        {
+            result *= square;
+        }
+        if (n > 1)
+        {
+            square *= square;
+        }
+    }
     return result;
 }
 
-polynomial operator+(int x, const polynomial &p)
+polynomial polynomial::pow(unsigned int n) const
 {
-    return p + x;
+    return pow(n, pow_engine::automatic);
+}
+
+polynomial polynomial::pow(unsigned int n, pow_engine engine) const
+{
+    if (n == 0)
+    {
+        return polynomial() + 1;
+    }
+    if (n == 1 || (terms.size() == 1 && terms.begin()->second == 0))
+    {
+        return *this;
+    }
+    if (terms.begin()->first > std::numeric_limits<power>::max() / n)
+    {
+        throw std::overflow_error("power degree out of range");
+    }
+
+    if (terms.size() == 1)
+    {
+        // c^n x^(n k), with c^n wrapping mod 2^32 like every product
+        uint32_t c = 1;
+        uint32_t square = static_cast<uint32_t>(terms.begin()->second);
+        for (unsigned int m = n; m != 0; m >>= 1)
+        {
+            if (m & 1)
+            {
+                c *= square;
+            }
+            square *= square;
+        }
+
+        polynomial result;
+        result.terms.clear();
+        result.terms[terms.begin()->first * n] = static_cast<coeff>(c);
+        clean(result.terms, result.digest);
+        return result;
+    }
+
+    // only spread the base out densely when the recurrence might take it
+    size_t d = terms.begin()->first - terms.rbegin()->first;
+    power low = 0;
+    std::vector<int64_t> h;
+    if (engine == pow_engine::miller || (engine == pow_engine::automatic && d <= MILLER_MAX_DEGREE))
+    {
+        h = shifted_coeffs(terms, low);
+    }
+
+    bool miller = engine == pow_engine::miller ||
+                  (engine == pow_engine::automatic && d <= MILLER_MAX_DEGREE && miller_fits(h, n));
+
+    if (!miller)
+    {
+        polynomial result = polynomial() + 1;
+        polynomial base(*this);
+        for (; n != 0; n >>= 1)
+        {
+            if (n & 1)
+            {
+                result = result * base;
+            }
+            if (n > 1)
+            {
+                base = base * base;
+            }
+        }
+        return result;
+    }
+
+    if (!miller_fits(h, n))
+    {
+        throw std::runtime_error("error");
+    }
+
+    // g_k only looks back d coefficients, so those are all that stay exact
+    size_t length = n * d + 1;
+    std::vector<__int128> window(d + 1);
+    dense_coeffs c(length);
+
+    __int128 g0 = power_of(h[0], n);
+    window[0] = g0;
+    c[0] = static_cast<uint32_t>(g0);
+
+    for (size_t k = 1; k < length; k++)
+    {
+        __int128 sum = 0;
+        for (size_t i = 1; i <= std::min(d, k); i++)
+        {
+            __int128 weight = static_cast<__int128>(n + 1) * i - static_cast<__int128>(k);
+            sum += weight * h[i] * window[(k - i) % (d + 1)];
+        }
+
+        __int128 g = sum / (static_cast<__int128>(k) * h[0]);
+        window[k % (d + 1)] = g;
+        c[k] = static_cast<uint32_t>(g);
+    }
+
+    polynomial result;
+    from_dense(c, n * low, result.terms);
+    clean(result.terms, result.digest);
+    return result;
 }
 
 // parallel operator* implementation using unordered_map
 
-polynomial polynomial::operator*(const polynomial &other) const
+polynomial polynomial::multiply_schoolbook(const polynomial &other) const
 {
     // zero checks
     if ((terms.size() == 1 && terms.begin()->second == 0) || (other.terms.size() == 1 && other.terms.begin()->second == 0))
@@ -139,8 +1582,7 @@ polynomial polynomial::operator*(const polynomial &other) const
         return polynomial();
     }
 
-    const int MAX_THREADS = 8;
-    int num = static_cast<int>(std::min<size_t>(MAX_THREADS, a.size()));
+    int num = static_cast<int>(std::min<size_t>(max_threads(), a.size()));
 
     // small polynomials
     if (num <= 1)
@@ -158,7 +1600,7 @@ polynomial polynomial::operator*(const polynomial &other) const
             }
         }
 
-        clean(result.terms);
+        clean(result.terms, result.digest);
         return result;
     }
 
@@ -187,7 +1629,7 @@ polynomial polynomial::operator*(const polynomial &other) const
         tasks[t].end = end;
         tasks[t].partial = &partials[t];
 
-        pthread_create(&threads[t], nullptr, multiply, &tasks[t]);
+        pthread_create(&threads[t], nullptr, ::multiply, &tasks[t]);
     }
 
     // join threads
@@ -211,7 +1653,7 @@ polynomial polynomial::operator*(const polynomial &other) const
         }
     }
 
-    clean(result.terms);
+    clean(result.terms, result.digest);
     return result;
 }
 
@@ -224,7 +1666,7 @@ polynomial polynomial::operator*(int x) const
         t.second *= x;
     }
 
-    clean(result.terms);
+    clean(result.terms, result.digest);
     return result;
 }
 
@@ -234,6 +1676,16 @@ polynomial operator*(int x, const polynomial &p)
 }
 
 polynomial polynomial::operator%(const polynomial &mod) const
+{
+    return remainder(mod, cache_policy::use);
+}
+
+polynomial polynomial::remainder(const polynomial &mod, cache_policy policy) const
+{
+    return cached(cache_op::remainder, mod, policy);
+}
+
+polynomial polynomial::remainder_uncached(const polynomial &mod) const
 {
 
     if (mod.terms.size() == 1 && mod.terms.begin()->second == 0)
@@ -241,11 +1693,23 @@ polynomial polynomial::operator%(const polynomial &mod) const
         throw std::runtime_error("error");
     }
 
+    // a unit leading coefficient makes every quotient step exact, so the
+    // long division below equals the Newton-iteration remainder
+    coeff lead = mod.terms.begin()->second;
+    power deg_a = terms.begin()->first;
+    power deg_d = mod.terms.begin()->first;
+    if ((lead == 1 || lead == -1) && deg_a >= deg_d && deg_d > 0 &&
+        (deg_a - deg_d + 1) * mod.terms.size() >= FAST_REMAINDER_STEPS &&
+        deg_a < std::max<size_t>(FAST_REMAINDER_SPAN, 16 * terms.size()))
+    {
+        return remainder_dense(mod);
+    }
+
     polynomial remainder(*this);
     polynomial d(mod);
 
-    clean(remainder.terms);
-    clean(d.terms);
+    clean(remainder.terms, remainder.digest);
+    clean(d.terms, d.digest);
 
     while (remainder.find_degree_of() >= d.find_degree_of() && !(remainder.terms.size() == 1 && remainder.terms.begin()->second == 0))
     {
@@ -256,25 +1720,51 @@ polynomial polynomial::operator%(const polynomial &mod) const
         coeff coef_d = d.terms[deg_d];
 
         size_t pow = deg_r - deg_d;
-        coeff coef = coef_r / coef_d;
+        // INT_MIN / -1 overflows; the wrapping quotient is just the negation
+        coeff coef = coef_d == -1 ? static_cast<coeff>(0u - static_cast<uint32_t>(coef_r)) : coef_r / coef_d;
         polynomial temp;
         
         temp.terms.clear();
         temp.terms[pow] = coef;
 
-        polynomial subtract = temp * d;
+        polynomial subtract = temp.multiply_uncached(d);
 
         for (auto &t : subtract.terms)
         {
             remainder.terms[t.first] -= t.second;
         }
 
-        clean(remainder.terms);
+        clean(remainder.terms, remainder.digest);
     }
 
     return remainder;
 }
 
+polynomial polynomial::remainder_dense(const polynomial &mod) const
+{
+    dense_coeffs a(terms.begin()->first + 1, 0);
+    for (auto &t : terms)
+    {
+        a[t.first] = static_cast<uint32_t>(t.second);
+    }
+
+    dense_coeffs d(mod.terms.begin()->first + 1, 0);
+    for (auto &t : mod.terms)
+    {
+        d[t.first] = static_cast<uint32_t>(t.second);
+    }
+
+    polynomial result;
+    from_dense(dense_remainder(a, d, max_threads()), 0, result.terms);
+    clean(result.terms, result.digest);
+    return result;
+}
+
+size_t polynomial::term_count() const
+{
+    return terms.size() == 1 && terms.begin()->second == 0 ? 0 : terms.size();
+}
+
 size_t polynomial::find_degree_of()
 {
     return terms.begin()->first;
@@ -299,3 +1789,84 @@ std::vector<std::pair<power, coeff>> polynomial::canonical_form() const
 
     return out;
 }
+
+// binary polynomial format
+
+static const char BINARY_MAGIC[4] = {'P', 'O', 'L', 'Y'};
+static const uint32_t BINARY_VERSION = 1;
+static const size_t BINARY_HEADER = 16;
+static const size_t BINARY_TERM = 12;
+
+static void put_le(std::vector<char> &out, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++)
+    {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+static uint64_t get_le(const char *in, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+std::vector<char> polynomial::to_binary() const
+{
+    std::vector<std::pair<power, coeff>> form = canonical_form();
+
+    std::vector<char> out(BINARY_MAGIC, BINARY_MAGIC + 4);
+    out.reserve(BINARY_HEADER + form.size() * BINARY_TERM);
+    put_le(out, BINARY_VERSION, 4);
+    put_le(out, form.size(), 8);
+
+    for (auto &t : form)
+    {
+        put_le(out, t.first, 8);
+        put_le(out, static_cast<uint32_t>(t.second), 4);
+    }
+
+    return out;
+}
+
+polynomial polynomial::from_binary(const char *data, size_t size)
+{
+    if (size < BINARY_HEADER || !std::equal(BINARY_MAGIC, BINARY_MAGIC + 4, data) || get_le(data + 4, 4) != BINARY_VERSION)
+    {
+        throw std::runtime_error("error");
+    }
+
+    uint64_t count = get_le(data + 8, 8);
+    if (count == 0 || count > (size - BINARY_HEADER) / BINARY_TERM || size != BINARY_HEADER + count * BINARY_TERM)
+    {
+        throw std::runtime_error("error");
+    }
+
+    polynomial result;
+    result.terms.clear();
+
+    // the canonical form is sorted by descending power, so every insert is at the end
+    const char *in = data + BINARY_HEADER;
+    for (uint64_t i = 0; i < count; i++, in += BINARY_TERM)
+    {
+        uint64_t p = get_le(in, 8);
+        if (p > std::numeric_limits<power>::max())
+        {
+            throw std::overflow_error("power out of range");
+        }
+        coeff c = static_cast<coeff>(static_cast<uint32_t>(get_le(in + 8, 4)));
+        result.terms.emplace_hint(result.terms.end(), static_cast<power>(p), c);
+    }
+
+    if (result.terms.size() != count)
+    {
+        throw std::runtime_error("error");
+    }
+
+    clean(result.terms, result.digest);
+    return result;
+}
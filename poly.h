@@ -5,14 +5,111 @@
 #include <utility>
 #include <cstddef>
 #include <map>
+#include <cstdint>
+#include <string>
+#include <functional>
 
+/**
+ * Building with POLY_COMPACT_POWER defined stores powers in 32 bits, which
+ * halves a (power, coeff) pair to 8 bytes in canonical_form(), the term maps
+ * and the working buffers of operator*. Degrees must then stay below 2^32:
+ * products and powers whose degree would not fit throw std::overflow_error,
+ * as does reading a binary form that holds a larger power.
+ */
+#ifdef POLY_COMPACT_POWER
+using power = uint32_t;
+#else
 using power = size_t;
+#endif
 using coeff = int;
 
+/**
+ * @brief A 128-bit digest of a polynomial's terms. Two polynomials with the
+ *        same canonical form always have the same digest.
+ */
+struct content_hash
+{
+    uint64_t lo;
+    uint64_t hi;
+};
+
+/**
+ * @brief Whether a single operation may consult the result cache.
+ */
+enum class cache_policy
+{
+    use,
+    bypass
+};
+
+enum class cache_op : uint8_t;
+
+/**
+ * @brief The algorithms operator* can use. automatic picks one per call from
+ *        the sizes and shapes of the operands; the others force an engine.
+ *        Every engine produces exactly the same result.
+ */
+enum class mult_engine
+{
+    automatic,
+    schoolbook, // all |a|*|b| term products, rows of a split across threads
+    ntt,        // dense three-prime number-theoretic transform
+    sort_reduce, // all term products into flat buffers, radix sorted, then summed
+    karatsuba,   // dense Karatsuba
+    unbalanced,  // the longer operand sliced into blocks the size of the shorter
+    fft          // split into 11-bit digits, double-precision FFT; NTT if the error bound fails
+};
+
+/**
+ * @brief The algorithms pow() can use. automatic takes the Miller recurrence
+ *        whenever it applies to a low-degree base; both give the same result.
+ */
+enum class pow_engine
+{
+    automatic,
+    squaring, // binary powering through operator*
+    miller    // the J.C.P. Miller recurrence, in exact 128-bit integers; small exponents only
+};
+
+/**
+ * @brief Counters describing the result caches since they were last enabled.
+ *        The disk_ fields cover the on-disk cache, the rest the in-memory one.
+ */
+struct cache_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t terms;
+    size_t capacity;
+
+    uint64_t disk_hits;
+    uint64_t disk_misses;
+    size_t disk_bytes;
+
+    double hit_rate() const;
+};
+
 class polynomial
 {
 private:
     std::map<power, coeff, std::greater<power>> terms;
+    content_hash digest; // kept in sync with terms by every operation
+
+    polynomial multiply_uncached(const polynomial &other) const;
+    polynomial remainder_uncached(const polynomial &divisor) const;
+    polynomial cached(cache_op op, const polynomial &other, cache_policy policy) const;
+    polynomial multiply_schoolbook(const polynomial &other) const;
+    polynomial multiply_ntt(const polynomial &other) const;
+    polynomial multiply_fft(const polynomial &other) const;
+    polynomial multiply_sort_reduce(const polynomial &other) const;
+    polynomial multiply_monomial(power k, coeff c) const;
+    polynomial multiply_karatsuba(const polynomial &other) const;
+    polynomial multiply_dense(const polynomial &other) const;
+    polynomial multiply_unbalanced(const polynomial &other) const;
+    polynomial remainder_dense(const polynomial &divisor) const;
+    polynomial multiply_wrapped(const polynomial &other, size_t n, bool negacyclic) const;
 public:
     /**
      * @brief Construct a new polynomial object that is the number 0 (ie. 0x^0)
@@ -60,6 +157,25 @@ public:
      */
     polynomial &operator=(const polynomial &other);
 
+    /**
+     * @brief Returns the 128-bit content hash of the polynomial. It is kept up
+     *        to date as the polynomial is built, so this is O(1). It is a sum
+     *        of per-term hashes, so colliding inputs are easy to construct;
+     *        don't rely on it to tell apart polynomials an adversary picks.
+     *
+     * @return content_hash
+     *  A digest that is equal for any two equal polynomials
+     */
+    content_hash hash() const;
+
+    /**
+     * @brief Compares two polynomials term by term. Polynomials with different
+     *        hashes, term counts or degrees are rejected without touching the
+     *        terms themselves.
+     */
+    bool operator==(const polynomial &other) const;
+    bool operator!=(const polynomial &other) const;
+
 
     /**
      * Overload the +, * and % operators. The function prototypes are not
@@ -86,6 +202,242 @@ public:
     friend polynomial operator*(int x, const polynomial &p);
     polynomial operator%(const polynomial &divisor) const;
 
+    /**
+     * @brief Adds other in place. Only the powers of other are touched, and
+     *        the content hash is updated term by term, so the cost is
+     *        O(|other| log n) however large this polynomial is.
+     */
+    polynomial &operator+=(const polynomial &other);
+
+    /**
+     * @brief Same as operator* and operator%, but lets the caller skip the
+     *        result cache for this one call.
+     *
+     * @param policy
+     *  cache_policy::bypass always recomputes and never stores the result
+     */
+    polynomial multiply(const polynomial &other, cache_policy policy) const;
+    polynomial remainder(const polynomial &divisor, cache_policy policy) const;
+
+    /**
+     * @brief Multiplies with a specific engine, bypassing the result cache.
+     *
+     * @param engine
+     *  The engine to use; mult_engine::automatic behaves like operator*
+     */
+    polynomial multiply(const polynomial &other, mult_engine engine) const;
+
+    /**
+     * @brief Multiplies modulo x^n - 1 (cyclic convolution) without building
+     *        the full product: both operands are folded into n coefficients
+     *        first and, for n = 2^k, 3 * 2^k or 5 * 2^k, multiplied with size-n
+     *        transforms.
+     *        Throws std::runtime_error if n is 0.
+     *
+     * @param n
+     *  The ring size; the result has degree below n
+     */
+    polynomial multiply_cyclic(const polynomial &other, size_t n) const;
+
+    /**
+     * @brief Multiplies modulo x^n + 1 (negacyclic convolution), the same way
+     *        as multiply_cyclic() but with the transforms twisted by a 2n-th
+     *        root of unity. Throws std::runtime_error if n is 0.
+     *
+     * @param n
+     *  The ring size; the result has degree below n
+     */
+    polynomial multiply_negacyclic(const polynomial &other, size_t n) const;
+
+    /**
+     * @brief Raises the polynomial to the n-th power (x^0 = 1, including for 0).
+     *
+     * For a base h = x^v (h_0 + ... + h_d x^d) with small d, the coefficients
+     * of h^n follow from h (h^n)' = n h' h^n one at a time:
+     *  k h_0 g_k = sum over 1 <= i <= d of ((n + 1) i - k) h_i g_(k - i),
+     * which is O(n d^2) work with only d + 1 live values. The division by k
+     * is exact over the integers but not mod 2^32, so the recurrence runs in
+     * 128-bit integers and is only used when |h|_1^(n + 1) and the step sums
+     * provably fit: (n + 1) (d + 1)^2 |h|_1^(n + 1) <= 2^125. That limits it
+     * to small exponents, falling as the coefficients grow: (x + 1)^n up to
+     * n = 115, (x^2 + x + 1)^n up to n = 71, and only n = 2 once a
+     * coefficient nears 2^31. Otherwise pow() squares through operator*. A
+     * single term c x^k needs neither: it is c^n x^(n k), in O(log n).
+     *
+     * @param engine
+     *  automatic checks the bound (O(d) plus at most 125 steps) and never
+     *  throws for it; pow_engine::miller throws std::runtime_error if the
+     *  bound doesn't hold, so ask for it only when it's known to
+     */
+    polynomial pow(unsigned int n) const;
+    polynomial pow(unsigned int n, pow_engine engine) const;
+
+    /**
+     * @brief Returns every engine other than mult_engine::automatic, so
+     *        callers can run the same product through each of them.
+     */
+    static std::vector<mult_engine> engines();
+
+    /**
+     * @brief Sets how many threads a single operation may use. Defaults to 8.
+     *        Operations running as one of several parallel tasks (e.g. the
+     *        nodes of a product tree level) use a single thread each.
+     *
+     * @param threads
+     *  The thread limit; values below 1 are treated as 1
+     */
+    static void set_max_threads(int threads);
+    static int max_threads();
+
+    /**
+     * @brief Sets the transform length from which the NTT engine switches to
+     *        the six-step decomposition (cache-sized row transforms, tiled
+     *        transposes, every pass split across threads). For tuning on a
+     *        given machine; defaults to 2^20, and SIZE_MAX turns it off.
+     */
+    static void set_six_step_cutoff(size_t length);
+
+    /**
+     * @brief Precomputes the NTT and FFT engines' root-of-unity tables for
+     *        every product of up to max_terms coefficients, so that
+     *        latency-sensitive first calls don't pay for building them.
+     *        Optional; the tables are otherwise built on first use and kept.
+     */
+    static void warm_up(size_t max_terms);
+
+    /**
+     * @brief Dense buffers of 8 MB and up are kept in a pool once freed, so
+     *        the next large product starts on memory that is already faulted
+     *        in. The pool holds up to 256 MB by default; this sets that limit
+     *        (0 turns pooling off) and trims the pool to it at once.
+     */
+    static void set_buffer_pool_limit(size_t bytes);
+
+    /**
+     * @brief Returns every pooled buffer to the system, e.g. once a batch of
+     *        large products is done.
+     */
+    static void release_buffers();
+
+    /**
+     * @brief Turns on the shared LRU cache of operator* and operator% results.
+     *        The cache is off by default. Calling this again replaces the
+     *        cache (and its counters) with an empty one. Entries are found by
+     *        a secret-keyed hash of both operands rather than hash(), so each
+     *        cached call first spends O(terms) hashing them.
+     *
+     * @param capacity
+     *  The maximum number of result terms held across all cached entries
+     */
+    static void enable_result_cache(size_t capacity);
+
+    /**
+     * @brief Turns the result cache off and frees its entries.
+     */
+    static void disable_result_cache();
+
+    /**
+     * @brief Turns on a result cache stored as files in a local directory, so
+     *        results survive process restarts. It is consulted after the
+     *        in-memory cache (if any) and before recomputing. Entries use the
+     *        binary polynomial format (see to_binary()), are written atomically
+     *        and the least recently used files are deleted to stay in budget.
+     *        File names come from hashes keyed by a secret stored in the
+     *        directory, so anyone who can write there must be trusted anyway.
+     *        Each new file costs a write, an fsync of the file and one of the
+     *        directory, so cheap operations skip the disk cache altogether.
+     *
+     * @param directory
+     *  The directory holding the cache files, created if it doesn't exist
+     * @param max_bytes
+     *  The maximum total size of the cache files
+     * @param min_cost
+     *  Operations whose operand term counts multiply to less than this are
+     *  neither looked up on disk nor persisted
+     */
+    static void enable_disk_cache(const std::string &directory, size_t max_bytes, size_t min_cost = DISK_MIN_COST);
+
+    /**
+     * @brief The default min_cost of enable_disk_cache(): a 256 by 256 term
+     *        product, roughly where recomputing starts to cost more than the
+     *        two fsyncs of storing it.
+     */
+    static const size_t DISK_MIN_COST = 1 << 16;
+
+    /**
+     * @brief Stops using the on-disk cache. Files already written are kept.
+     */
+    static void disable_disk_cache();
+
+    /**
+     * @brief Returns the hit/miss counters of the result cache. All zero when
+     *        the cache is disabled.
+     */
+    static cache_stats result_cache_stats();
+
+    /**
+     * @brief Turns on a verify_product() check of every product computed by
+     *        operator* whose operands have at least min_terms terms between
+     *        them. A failed check throws std::runtime_error.
+     *
+     * @param min_terms
+     *  The smallest |a| + |b| that is checked, or 0 to turn the check off
+     */
+    static void set_product_verification(size_t min_terms);
+
+    /**
+     * @brief Checks whether c == a * b without recomputing the product.
+     *
+     * When no coefficient of a * b can overflow coeff, all three are evaluated
+     * at random points modulo two 61/62-bit primes (Schwartz-Zippel). A wrong
+     * c is accepted with probability below (deg c / 2^61)^2. O(|a|+|b|+|c|).
+     *
+     * Otherwise the wrapped coefficients are checked as they are, mod 2^32:
+     * all three are evaluated at t in Z/2^32[t]/(f), for a random f of
+     * degree 64 that is irreducible mod 2. A wrong c is accepted with
+     * probability below deg c / 2^64. This costs about 64 operations per
+     * power in the product's span (gaps included), so when that exceeds
+     * |a| |b| the product is recomputed with the schoolbook engine instead,
+     * at the cost of a second multiplication. A correct c is always accepted.
+     *
+     * @return true if c is (with high probability) the product of a and b
+     */
+    friend bool verify_product(const polynomial &a, const polynomial &b, const polynomial &c);
+
+    /**
+     * @brief Returns the coefficient of x^k (0 if there is no such term), in
+     *        O(log n).
+     */
+    coeff coefficient(power k) const;
+
+    /**
+     * @brief Returns the number of nonzero terms (0 for the polynomial 0), in
+     *        O(1).
+     */
+    size_t term_count() const;
+
+    /**
+     * @brief Returns the coefficient of x^k in a * b without building the
+     *        product: one pass over a's powers downwards and b's upwards
+     *        pairs every i with k - i. O(|a| + |b|).
+     */
+    friend coeff coefficient_of_product(const polynomial &a, const polynomial &b, power k);
+
+    /**
+     * @brief Returns the coefficients of x^low .. x^high in a * b, and nothing
+     *        else of the product. Dense operands take one windowed dot
+     *        product per output coefficient; sparse ones look up, for each
+     *        term of a, only the terms of b that land in the window. Long
+     *        windows are split across threads. Throws std::runtime_error if
+     *        low > high. high is clamped to deg a + deg b, since nothing above
+     *        it can be nonzero.
+     *
+     * @return std::vector<coeff>
+     *  min(high, deg a + deg b) - low + 1 coefficients (none if low is above
+     *  deg a + deg b); element j belongs to x^(low + j)
+     */
+    friend std::vector<coeff> coefficients_of_product(const polynomial &a, const polynomial &b, power low, power high);
+
     /**
      * @brief Returns the degree of the polynomial
      *
@@ -115,6 +467,40 @@ public:
      *  A vector of pairs representing the canonical form of the polynomial
      */
     std::vector<std::pair<power, coeff>> canonical_form() const;
+
+    /**
+     * @brief Serializes the polynomial into the binary polynomial format: the
+     *        bytes "POLY", a uint32 format version, a uint64 term count, then
+     *        every term of the canonical form as a uint64 power followed by an
+     *        int32 coeff. All integers are little-endian.
+     *
+     * @return std::vector<char>
+     *  The encoded bytes
+     */
+    std::vector<char> to_binary() const;
+
+    /**
+     * @brief Decodes a buffer written by to_binary(). Throws std::runtime_error
+     *        if the buffer is truncated or isn't in the binary polynomial format.
+     *
+     * @param data
+     *  The start of the encoded bytes
+     * @param size
+     *  The number of encoded bytes
+     */
+    static polynomial from_binary(const char *data, size_t size);
 };
 
+namespace std
+{
+    template <>
+    struct hash<polynomial>
+    {
+        size_t operator()(const polynomial &p) const
+        {
+            return static_cast<size_t>(p.hash().lo);
+        }
+    };
+}
+
 #endif
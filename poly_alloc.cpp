@@ -0,0 +1,216 @@
+#include "poly_alloc.h"
+#include "poly_thread.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const size_t HUGE_PAGE = size_t(2) << 20;
+
+// Buffers that all start on a 2 MB boundary put element k of each in the same
+// cache sets, and kernels walking several at once (Garner recombination reads
+// three residues and writes a fourth) then evict each other. Successive
+// buffers start this many bytes further in.
+static const size_t COLOUR_STEP = 4096 + BUFFER_ALIGNMENT;
+static const size_t COLOURS = 16;
+
+static std::mutex lock;
+static size_t next_colour = 0;
+static std::unordered_map<uintptr_t, size_t> live; // mapping start -> size, for buffers in use
+static std::multimap<size_t, uintptr_t> pool;      // size -> start, for free ones
+static size_t pooled = 0;
+static size_t pool_limit = DEFAULT_POOL_BYTES;
+
+// polynomial's default thread limit, until set_max_threads() passes another
+static std::atomic<int> fault_threads(8);
+
+static size_t huge_pages_for(size_t bytes)
+{
+    return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+}
+
+// One task per huge page, handed out to the threads the way the kernels hand
+// out their ranges. MADV_POPULATE_WRITE faults each page in once, as a huge
+// page if the kernel grants one; without it, a write per base page does the
+// same, and after the first of each 2 MB the rest are plain stores.
+static void prefault(char *buffer, size_t size)
+{
+    parallel_for(size / HUGE_PAGE, fault_threads.load(std::memory_order_relaxed), [&](size_t k)
+    {
+        char *page = buffer + k * HUGE_PAGE;
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(page, HUGE_PAGE, MADV_POPULATE_WRITE) == 0)
+        {
+            return;
+        }
+#endif
+        const size_t base = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        for (size_t i = 0; i < HUGE_PAGE; i += base)
+        {
+            page[i] = 0;
+        }
+    });
+}
+
+// over-map by one huge page, then trim both ends to a 2 MB boundary so the
+// kernel can back the whole range with huge pages
+static char *map_huge(size_t size)
+{
+    void *mapped = mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+    uintptr_t aligned = (start + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+    if (aligned != start)
+    {
+        munmap(mapped, aligned - start);
+    }
+    if (aligned + size != start + size + HUGE_PAGE)
+    {
+        munmap(reinterpret_cast<void *>(aligned + size), start + HUGE_PAGE - aligned);
+    }
+
+    char *buffer = reinterpret_cast<char *>(aligned);
+#ifdef MADV_HUGEPAGE
+    madvise(buffer, size, MADV_HUGEPAGE); // only advice; plain pages still work
+#endif
+    prefault(buffer, size);
+    return buffer;
+}
+
+void *allocate_buffer(size_t bytes)
+{
+    if (bytes < HUGE_PAGE_THRESHOLD)
+    {
+        // aligned_alloc wants a multiple of the alignment
+        void *buffer = std::aligned_alloc(BUFFER_ALIGNMENT, std::max<size_t>(1, (bytes + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT) * BUFFER_ALIGNMENT);
+        if (buffer == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return buffer;
+    }
+
+    size_t offset;
+    size_t size;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        offset = next_colour++ % COLOURS * COLOUR_STEP;
+        size = huge_pages_for(offset + bytes);
+
+        // the smallest pooled mapping that fits, unless it's twice too big
+        auto it = pool.lower_bound(size);
+        if (it != pool.end() && it->first <= 2 * size)
+        {
+            uintptr_t start = it->second;
+            live[start] = it->first;
+            pooled -= it->first;
+            pool.erase(it);
+            return reinterpret_cast<char *>(start) + offset;
+        }
+    }
+
+    char *buffer = map_huge(size);
+
+    std::lock_guard<std::mutex> guard(lock);
+    live[reinterpret_cast<uintptr_t>(buffer)] = size;
+    return buffer + offset;
+}
+
+// takes the largest pooled mappings out until at most limit bytes stay, for
+// the caller to unmap once it drops the lock
+static std::vector<std::pair<uintptr_t, size_t>> take_largest(size_t limit)
+{
+    std::vector<std::pair<uintptr_t, size_t>> taken;
+    while (pooled > limit)
+    {
+        auto last = std::prev(pool.end());
+        taken.push_back({last->second, last->first});
+        pooled -= last->first;
+        pool.erase(last);
+    }
+    return taken;
+}
+
+static void unmap_all(const std::vector<std::pair<uintptr_t, size_t>> &mappings)
+{
+    for (const auto &m : mappings)
+    {
+        munmap(reinterpret_cast<void *>(m.first), m.second);
+    }
+}
+
+void free_buffer(void *buffer, size_t bytes)
+{
+    if (bytes < HUGE_PAGE_THRESHOLD)
+    {
+        std::free(buffer);
+        return;
+    }
+
+    // the colour offset is below one huge page, so the mapping starts at the
+    // boundary below the buffer
+    uintptr_t start = reinterpret_cast<uintptr_t>(buffer) / HUGE_PAGE * HUGE_PAGE;
+    std::vector<std::pair<uintptr_t, size_t>> unmap;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = live.find(start);
+        size_t size = it->second;
+        live.erase(it);
+
+        // make room by dropping the largest pooled mappings first; one over
+        // the limit on its own isn't kept at all
+        if (size > pool_limit)
+        {
+            unmap.push_back({start, size});
+        }
+        else
+        {
+            unmap = take_largest(pool_limit - size);
+            pool.insert({size, start});
+            pooled += size;
+        }
+    }
+
+    unmap_all(unmap);
+}
+
+void set_buffer_fault_threads(int threads)
+{
+    fault_threads.store(std::max(1, threads), std::memory_order_relaxed);
+}
+
+void set_buffer_pool_limit(size_t bytes)
+{
+    std::vector<std::pair<uintptr_t, size_t>> unmap;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pool_limit = bytes;
+        unmap = take_largest(pool_limit);
+    }
+    unmap_all(unmap);
+}
+
+void release_buffers()
+{
+    std::vector<std::pair<uintptr_t, size_t>> unmap;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        unmap = take_largest(0);
+    }
+    unmap_all(unmap);
+}
+
+size_t pooled_buffer_bytes()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return pooled;
+}
@@ -0,0 +1,114 @@
+#ifndef POLY_ALLOC_H
+#define POLY_ALLOC_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * @brief Every buffer from allocate_buffer() starts on a 64-byte boundary,
+ *        so SIMD loads over it never split a cache line.
+ */
+const size_t BUFFER_ALIGNMENT = 64;
+
+/**
+ * @brief Buffers at least this large are mapped on their own, 2 MB aligned,
+ *        and marked for transparent huge pages, which cuts their TLB misses by
+ *        a factor of 512. Smaller ones come from the heap.
+ */
+const size_t HUGE_PAGE_THRESHOLD = size_t(8) << 20;
+
+/**
+ * @brief Freed huge mappings kept for reuse by default, in bytes. Faulting
+ *        in huge pages means zeroing and often compacting 2 MB at a time, so
+ *        a product that reuses its predecessor's buffers skips that.
+ */
+const size_t DEFAULT_POOL_BYTES = size_t(256) << 20;
+
+/**
+ * @brief Allocates `bytes` of uninitialized memory, aligned to
+ *        BUFFER_ALIGNMENT. A new mapping at or above HUGE_PAGE_THRESHOLD is
+ *        faulted in up front, one huge page per task across the threads set
+ *        by set_buffer_fault_threads(), so the serial value-initialization
+ *        that follows in std::vector takes no page faults. Throws
+ *        std::bad_alloc on failure.
+ */
+void *allocate_buffer(size_t bytes);
+
+/**
+ * @brief Sets how many threads fault in a new huge mapping; polynomial's
+ *        set_max_threads() passes its limit down here. Defaults to 8.
+ */
+void set_buffer_fault_threads(int threads);
+
+/**
+ * @brief Frees a buffer from allocate_buffer(); bytes must be the size it
+ *        was allocated with. Huge mappings go to a pool, up to the limit from
+ *        set_buffer_pool_limit(), that later large buffers are taken from
+ *        already faulted in; the largest are unmapped first to stay under it.
+ */
+void free_buffer(void *buffer, size_t bytes);
+
+/**
+ * @brief Sets how many bytes of freed huge mappings the pool keeps, and
+ *        unmaps whatever is over it now. 0 keeps none.
+ */
+void set_buffer_pool_limit(size_t bytes);
+
+/**
+ * @brief Returns every pooled huge mapping to the system.
+ */
+void release_buffers();
+
+/**
+ * @brief Returns the bytes currently pooled.
+ */
+size_t pooled_buffer_bytes();
+
+/**
+ * @brief A standard allocator over allocate_buffer(), for the vectors that
+ *        hold dense coefficients and transform data.
+ */
+template <typename T>
+struct buffer_allocator
+{
+    using value_type = T;
+
+    buffer_allocator() = default;
+
+    template <typename U>
+    buffer_allocator(const buffer_allocator<U> &)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        if (n > size_t(-1) / sizeof(T))
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(allocate_buffer(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        free_buffer(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const buffer_allocator<U> &) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const buffer_allocator<U> &) const
+    {
+        return false;
+    }
+};
+
+template <typename T>
+using buffer = std::vector<T, buffer_allocator<T>>;
+
+#endif
@@ -0,0 +1,227 @@
+#include "poly_block.h"
+#include "poly_thread.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+const size_t block_polynomial::BLOCK_TERMS;
+
+static bool all_zero(const dense_coeffs &block)
+{
+    return std::all_of(block.begin(), block.end(), [](uint32_t c) { return c == 0; });
+}
+
+block_polynomial::block_polynomial()
+{
+}
+
+block_polynomial::block_polynomial(const polynomial &p)
+{
+    for (const auto &t : p.canonical_form())
+    {
+        if (t.second == 0)
+        {
+            continue; // the zero polynomial
+        }
+
+        dense_coeffs &block = blocks[t.first / BLOCK_TERMS];
+        if (block.empty())
+        {
+            block.assign(BLOCK_TERMS, 0);
+        }
+        block[t.first % BLOCK_TERMS] = static_cast<uint32_t>(t.second);
+    }
+}
+
+polynomial block_polynomial::to_polynomial() const
+{
+    std::vector<std::pair<power, coeff>> form;
+    for (const auto &b : blocks)
+    {
+        for (size_t i = 0; i < BLOCK_TERMS; i++)
+        {
+            if (b.second[i] != 0)
+            {
+                form.push_back({static_cast<power>(b.first * BLOCK_TERMS + i), static_cast<coeff>(b.second[i])});
+            }
+        }
+    }
+    return polynomial(form.begin(), form.end());
+}
+
+coeff block_polynomial::coefficient(power k) const
+{
+    auto it = blocks.find(k / BLOCK_TERMS);
+    return it == blocks.end() ? 0 : static_cast<coeff>(it->second[k % BLOCK_TERMS]);
+}
+
+size_t block_polynomial::block_count() const
+{
+    return blocks.size();
+}
+
+bool block_polynomial::operator==(const block_polynomial &other) const
+{
+    return blocks == other.blocks;
+}
+
+bool block_polynomial::operator!=(const block_polynomial &other) const
+{
+    return !(*this == other);
+}
+
+block_polynomial block_polynomial::operator+(const block_polynomial &other) const
+{
+    // every block index in either operand, each summed on its own
+    std::vector<power> index;
+    for (const auto &b : blocks)
+    {
+        index.push_back(b.first);
+    }
+    for (const auto &b : other.blocks)
+    {
+        index.push_back(b.first);
+    }
+    std::sort(index.begin(), index.end());
+    index.erase(std::unique(index.begin(), index.end()), index.end());
+
+    std::vector<dense_coeffs> sums(index.size());
+
+    parallel_for(index.size(), polynomial::max_threads(), [&](size_t k)
+    {
+        auto x = blocks.find(index[k]);
+        auto y = other.blocks.find(index[k]);
+        if (x == blocks.end() || y == other.blocks.end())
+        {
+            sums[k] = x == blocks.end() ? y->second : x->second;
+            return;
+        }
+
+        sums[k].resize(BLOCK_TERMS);
+        for (size_t i = 0; i < BLOCK_TERMS; i++)
+        {
+            sums[k][i] = x->second[i] + y->second[i];
+        }
+    });
+
+    block_polynomial result;
+    for (size_t k = 0; k < index.size(); k++)
+    {
+        if (!all_zero(sums[k]))
+        {
+            result.blocks.emplace_hint(result.blocks.end(), index[k], std::move(sums[k]));
+        }
+    }
+    return result;
+}
+
+// the highest nonzero power, inside the top block
+static power top_power(const std::map<power, dense_coeffs> &blocks)
+{
+    const dense_coeffs &block = blocks.rbegin()->second;
+    size_t i = block_polynomial::BLOCK_TERMS - 1;
+    while (block[i] == 0)
+    {
+        i--; // stored blocks are never all zero
+    }
+    return blocks.rbegin()->first * block_polynomial::BLOCK_TERMS + i;
+}
+
+// adjacent blocks joined into one dense array
+struct block_run
+{
+    power first; // block index of the first coefficient
+    dense_coeffs coeffs;
+};
+
+static std::vector<block_run> runs_of(const std::map<power, dense_coeffs> &blocks)
+{
+    std::vector<block_run> runs;
+    for (const auto &b : blocks)
+    {
+        if (runs.empty() || runs.back().first + runs.back().coeffs.size() / block_polynomial::BLOCK_TERMS != b.first)
+        {
+            runs.push_back({b.first, {}});
+        }
+        runs.back().coeffs.insert(runs.back().coeffs.end(), b.second.begin(), b.second.end());
+    }
+    return runs;
+}
+
+block_polynomial block_polynomial::operator*(const block_polynomial &other) const
+{
+    block_polynomial result;
+    if (blocks.empty() || other.blocks.empty())
+    {
+        return result;
+    }
+
+    // the top block indices, and so every sum of two, fit whenever the top
+    // power does; the last block may reach past it, but only with zeros
+    if (top_power(blocks) > std::numeric_limits<power>::max() - top_power(other.blocks))
+    {
+        throw std::overflow_error("product degree out of range");
+    }
+
+    std::vector<block_run> a = runs_of(blocks);
+    std::vector<block_run> b = runs_of(other.blocks);
+
+    // one dense product per pair of runs; a lone pair keeps every thread for
+    // its own kernel, many pairs take one thread each
+    const int threads = polynomial::max_threads();
+    const size_t pairs = a.size() * b.size();
+    std::vector<block_run> pieces(pairs);
+
+    parallel_for(pairs, threads, [&](size_t k)
+    {
+        const block_run &x = a[k / b.size()];
+        const block_run &y = b[k % b.size()];
+        pieces[k].first = x.first + y.first;
+        pieces[k].coeffs = dense_multiply(x.coeffs, y.coeffs, pairs == 1 ? threads : 1);
+    });
+
+    // each result block sums the pieces overlapping it, so writers never meet
+    std::map<power, std::vector<size_t>> overlaps;
+    for (size_t k = 0; k < pairs; k++)
+    {
+        size_t count = (pieces[k].coeffs.size() + BLOCK_TERMS - 1) / BLOCK_TERMS;
+        for (size_t i = 0; i < count; i++)
+        {
+            overlaps[pieces[k].first + i].push_back(k);
+        }
+    }
+
+    std::vector<std::pair<power, const std::vector<size_t> *>> index;
+    for (const auto &o : overlaps)
+    {
+        index.push_back({o.first, &o.second});
+    }
+    std::vector<dense_coeffs> sums(index.size());
+
+    parallel_for(index.size(), threads, [&](size_t k)
+    {
+        dense_coeffs &sum = sums[k];
+        sum.assign(BLOCK_TERMS, 0);
+
+        for (size_t p : *index[k].second)
+        {
+            const dense_coeffs &c = pieces[p].coeffs;
+            size_t offset = (index[k].first - pieces[p].first) * BLOCK_TERMS;
+            size_t end = std::min(c.size(), offset + BLOCK_TERMS);
+            for (size_t i = offset; i < end; i++)
+            {
+                sum[i - offset] += c[i];
+            }
+        }
+    });
+
+    for (size_t k = 0; k < index.size(); k++)
+    {
+        if (!all_zero(sums[k]))
+        {
+            result.blocks.emplace_hint(result.blocks.end(), index[k].first, std::move(sums[k]));
+        }
+    }
+    return result;
+}
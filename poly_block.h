@@ -0,0 +1,67 @@
+#ifndef POLY_BLOCK_H
+#define POLY_BLOCK_H
+
+#include <cstddef>
+#include <map>
+
+#include "poly.h"
+#include "poly_dense.h"
+
+/**
+ * @brief A polynomial stored as dense blocks of BLOCK_TERMS coefficients,
+ *        keyed by block index (power / BLOCK_TERMS). Blocks that would be all
+ *        zero are not stored, so clusters of terms cost their dense size and
+ *        the gaps between them cost nothing.
+ *
+ * Addition adds block by block. Multiplication joins runs of adjacent blocks
+ * and multiplies every pair of runs with the dense kernels (Karatsuba, FFT or
+ * NTT by length), then sums the pieces into the result's blocks. Both spread
+ * the blocks (or run pairs) across polynomial::max_threads() threads; a
+ * single run pair gets all of them instead. Results wrap mod 2^32 exactly as
+ * polynomial's do.
+ */
+class block_polynomial
+{
+public:
+    static const size_t BLOCK_TERMS = 256;
+
+    /**
+     * @brief Construct the number 0
+     */
+    block_polynomial();
+
+    /**
+     * @brief Construct a copy of a polynomial
+     */
+    explicit block_polynomial(const polynomial &p);
+
+    /**
+     * @brief Returns the same polynomial in the map representation
+     */
+    polynomial to_polynomial() const;
+
+    /**
+     * @brief Returns the coefficient of x^k
+     */
+    coeff coefficient(power k) const;
+
+    /**
+     * @brief Returns the number of blocks stored
+     */
+    size_t block_count() const;
+
+    bool operator==(const block_polynomial &other) const;
+    bool operator!=(const block_polynomial &other) const;
+
+    /**
+     * Same results as the polynomial operators. * throws std::overflow_error
+     * if the product's degree doesn't fit in power.
+     */
+    block_polynomial operator+(const block_polynomial &other) const;
+    block_polynomial operator*(const block_polynomial &other) const;
+
+private:
+    std::map<power, dense_coeffs> blocks; // every one BLOCK_TERMS long and nonzero
+};
+
+#endif
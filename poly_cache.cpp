@@ -0,0 +1,519 @@
+#include "poly_cache.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+hash_key hash_key::random()
+{
+    std::random_device source;
+    hash_key out;
+    out.k0 = (static_cast<uint64_t>(source()) << 32) ^ source();
+    out.k1 = (static_cast<uint64_t>(source()) << 32) ^ source();
+    return out;
+}
+
+static uint64_t rotl(uint64_t x, int b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+keyed_hasher::keyed_hasher(const hash_key &key)
+    : v0(key.k0 ^ 0x736f6d6570736575ULL),
+      v1(key.k1 ^ 0x646f72616e646f6dULL ^ 0xee),
+      v2(key.k0 ^ 0x6c7967656e657261ULL),
+      v3(key.k1 ^ 0x7465646279746573ULL),
+      length(0)
+{
+}
+
+void keyed_hasher::round()
+{
+    v0 += v1;
+    v1 = rotl(v1, 13);
+    v1 ^= v0;
+    v0 = rotl(v0, 32);
+    v2 += v3;
+    v3 = rotl(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotl(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotl(v1, 17);
+    v1 ^= v2;
+    v2 = rotl(v2, 32);
+}
+
+void keyed_hasher::add(uint64_t word)
+{
+    v3 ^= word;
+    round();
+    round();
+    v0 ^= word;
+    length += 8;
+}
+
+content_hash keyed_hasher::finish()
+{
+    uint64_t last = length << 56;
+    v3 ^= last;
+    round();
+    round();
+    v0 ^= last;
+
+    v2 ^= 0xee;
+    for (int i = 0; i < 4; i++)
+    {
+        round();
+    }
+    content_hash out;
+    out.lo = v0 ^ v1 ^ v2 ^ v3;
+
+    v1 ^= 0xdd;
+    for (int i = 0; i < 4; i++)
+    {
+        round();
+    }
+    out.hi = v0 ^ v1 ^ v2 ^ v3;
+    return out;
+}
+
+bool cache_key::operator==(const cache_key &other) const
+{
+    return op == other.op && a.lo == other.a.lo && a.hi == other.a.hi && b.lo == other.b.lo && b.hi == other.b.hi;
+}
+
+size_t cache_key_hasher::operator()(const cache_key &key) const
+{
+    uint64_t h = key.a.lo ^ (key.b.lo * 0x9e3779b97f4a7c15ULL) ^ static_cast<uint64_t>(key.op);
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+result_cache::result_cache(size_t capacity)
+    : capacity(capacity),
+      shards(new shard[SHARDS]),
+      total_terms(0),
+      hits(0),
+      misses(0),
+      evictions(0)
+{
+}
+
+result_cache::shard &result_cache::shard_for(const cache_key &key)
+{
+    // the low bits feed the shard's own unordered_map, so pick with the high ones
+    return shards[(key.a.hi ^ key.b.hi) >> 60];
+}
+
+bool result_cache::lookup(const cache_key &key, polynomial &out)
+{
+    shard &s = shard_for(key);
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    auto it = s.index.find(key);
+    if (it == s.index.end())
+    {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    s.order.splice(s.order.begin(), s.order, it->second);
+    out = it->second->value;
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void result_cache::insert(const cache_key &key, const polynomial &value, size_t weight)
+{
+    if (weight > capacity)
+    {
+        return;
+    }
+
+    shard &s = shard_for(key);
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        if (s.index.count(key))
+        {
+            return; // another thread got here first
+        }
+
+        s.order.push_front({key, value, weight});
+        s.index[key] = s.order.begin();
+        s.terms += weight;
+        total_terms.fetch_add(weight, std::memory_order_relaxed);
+    }
+
+    // evict from this shard first, then the others, holding one lock at a time
+    const size_t first = static_cast<size_t>(&s - shards.get());
+    for (size_t i = 0; i < SHARDS && total_terms.load(std::memory_order_relaxed) > capacity;)
+    {
+        shard &victim = shards[(first + i) % SHARDS];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        // the entry just stored stays
+        if (victim.order.empty() || victim.order.back().key == key)
+        {
+            i++;
+            continue;
+        }
+
+        const entry &last = victim.order.back();
+        victim.terms -= last.weight;
+        total_terms.fetch_sub(last.weight, std::memory_order_relaxed);
+        victim.index.erase(last.key);
+        victim.order.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+cache_stats result_cache::stats() const
+{
+    cache_stats out{};
+    out.hits = hits.load(std::memory_order_relaxed);
+    out.misses = misses.load(std::memory_order_relaxed);
+    out.evictions = evictions.load(std::memory_order_relaxed);
+    out.capacity = capacity;
+
+    for (size_t i = 0; i < SHARDS; i++)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        out.entries += shards[i].index.size();
+        out.terms += shards[i].terms;
+    }
+
+    return out;
+}
+
+// disk cache
+
+static const char *const DISK_SUFFIX = ".poly";
+static const char *const DISK_KEY = ".key";
+
+static bool read_key(const std::string &path, hash_key &out)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    uint64_t words[2];
+    size_t got = 0;
+    while (got < sizeof(words))
+    {
+        ssize_t n = read(fd, reinterpret_cast<char *>(words) + got, sizeof(words) - got);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        got += static_cast<size_t>(n);
+    }
+    close(fd);
+
+    if (got != sizeof(words))
+    {
+        throw std::runtime_error("error");
+    }
+    out = {words[0], words[1]};
+    return true;
+}
+
+// Makes a rename or link within directory durable; fsyncing the file itself
+// only covers its contents, not the entry pointing at it.
+static bool sync_directory(const std::string &directory)
+{
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    return close(fd) == 0 && ok;
+}
+
+// Reads the directory's key, creating it if this is the first process to get
+// here. A new key is written in full under a temporary name and linked into
+// place, and link() won't replace an existing file, so racing processes all
+// end up reading whichever key was published first.
+static hash_key load_key(const std::string &directory)
+{
+    std::string path = directory + "/" + DISK_KEY;
+    hash_key out;
+    if (read_key(path, out))
+    {
+        return out;
+    }
+
+    hash_key fresh = hash_key::random();
+    std::string temp = path + "." + std::to_string(getpid()) + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        throw std::runtime_error("error");
+    }
+
+    uint64_t words[2] = {fresh.k0, fresh.k1};
+    bool ok = write(fd, words, sizeof(words)) == static_cast<ssize_t>(sizeof(words)) && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    ok = ok && (link(temp.c_str(), path.c_str()) == 0 || errno == EEXIST);
+    unlink(temp.c_str());
+    ok = ok && sync_directory(directory);
+
+    if (!ok || !read_key(path, out))
+    {
+        throw std::runtime_error("error");
+    }
+    return out;
+}
+
+disk_cache::disk_cache(const std::string &directory, size_t max_bytes, size_t min_cost)
+    : directory(directory),
+      max_bytes(max_bytes),
+      min_cost(min_cost),
+      bytes(0),
+      temp_files(0),
+      hits(0),
+      misses(0)
+{
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw std::runtime_error("error");
+    }
+    secret_key = load_key(directory);
+
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr)
+    {
+        throw std::runtime_error("error");
+    }
+
+    // pick up entries left by earlier runs, most recently used first
+    std::vector<std::pair<time_t, std::string>> found;
+    std::vector<size_t> sizes;
+    const size_t suffix = std::char_traits<char>::length(DISK_SUFFIX);
+
+    while (dirent *d = readdir(dir))
+    {
+        std::string name = d->d_name;
+        if (name.size() <= suffix || name[0] == '.' || name.compare(name.size() - suffix, suffix, DISK_SUFFIX) != 0)
+        {
+            continue;
+        }
+
+        struct stat st;
+        if (stat((directory + "/" + name).c_str(), &st) == 0)
+        {
+            found.push_back({st.st_mtime, name});
+            sizes.push_back(static_cast<size_t>(st.st_size));
+        }
+    }
+    closedir(dir);
+
+    std::vector<size_t> by_age(found.size());
+    for (size_t i = 0; i < by_age.size(); i++)
+    {
+        by_age[i] = i;
+    }
+    std::sort(by_age.begin(), by_age.end(), [&](size_t x, size_t y) { return found[x].first > found[y].first; });
+
+    for (size_t i : by_age)
+    {
+        order.push_back(found[i].second);
+        files[found[i].second] = {std::prev(order.end()), sizes[i]};
+        bytes += sizes[i];
+    }
+
+    while (bytes > max_bytes && !order.empty())
+    {
+        std::string name = order.back();
+        unlink((directory + "/" + name).c_str());
+        forget(name);
+    }
+}
+
+bool disk_cache::worth_storing(size_t a_terms, size_t b_terms) const
+{
+    // a_terms * b_terms >= min_cost without the product overflowing
+    return b_terms != 0 && a_terms >= min_cost / b_terms + (min_cost % b_terms != 0);
+}
+
+std::string disk_cache::name_for(const cache_key &key)
+{
+    char name[80];
+    snprintf(name, sizeof(name), "%c%016llx%016llx%016llx%016llx%s",
+             key.op == cache_op::multiply ? 'm' : 'r',
+             static_cast<unsigned long long>(key.a.hi), static_cast<unsigned long long>(key.a.lo),
+             static_cast<unsigned long long>(key.b.hi), static_cast<unsigned long long>(key.b.lo),
+             DISK_SUFFIX);
+    return name;
+}
+
+void disk_cache::forget(const std::string &name)
+{
+    auto it = files.find(name);
+    if (it != files.end())
+    {
+        bytes -= it->second.bytes;
+        order.erase(it->second.position);
+        files.erase(it);
+    }
+}
+
+bool disk_cache::lookup(const cache_key &key, polynomial &out)
+{
+    std::string name = name_for(key);
+    std::string path = directory + "/" + name;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        forget(name); // evicted by another process sharing the directory
+        misses++;
+        return false;
+    }
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    size_t size = ok ? static_cast<size_t>(st.st_size) : 0;
+    void *data = ok ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (data != MAP_FAILED)
+    {
+        try
+        {
+            out = polynomial::from_binary(static_cast<const char *>(data), size);
+        }
+        catch (const std::runtime_error &)
+        {
+            ok = false;
+        }
+        munmap(data, size);
+    }
+    else
+    {
+        ok = false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ok)
+    {
+        unlink(path.c_str());
+        forget(name);
+        misses++;
+        return false;
+    }
+
+    // refresh the mtime so the recency order survives a restart
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+
+    auto it = files.find(name);
+    if (it != files.end())
+    {
+        order.splice(order.begin(), order, it->second.position);
+    }
+    else
+    {
+        order.push_front(name); // written by another process
+        files[name] = {order.begin(), size};
+        bytes += size;
+    }
+
+    hits++;
+    return true;
+}
+
+void disk_cache::insert(const cache_key &key, const polynomial &value)
+{
+    std::string name = name_for(key);
+    std::vector<char> data = value.to_binary();
+    if (data.size() > max_bytes)
+    {
+        return;
+    }
+
+    std::string temp;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (files.count(name))
+        {
+            return;
+        }
+        temp = directory + "/." + name + "." + std::to_string(getpid()) + "." + std::to_string(temp_files++) + ".tmp";
+    }
+
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    bool ok = written == data.size() && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+
+    std::string path = directory + "/" + name;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0)
+    {
+        unlink(temp.c_str());
+        return;
+    }
+
+    // without this a crash can lose the rename even though the data was synced
+    sync_directory(directory);
+
+    std::lock_guard<std::mutex> guard(lock);
+    forget(name);
+
+    while (bytes + data.size() > max_bytes && !order.empty())
+    {
+        std::string victim = order.back();
+        unlink((directory + "/" + victim).c_str());
+        forget(victim);
+    }
+
+    order.push_front(name);
+    files[name] = {order.begin(), data.size()};
+    bytes += data.size();
+}
+
+const hash_key &disk_cache::secret() const
+{
+    return secret_key;
+}
+
+void disk_cache::stats(cache_stats &out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    out.disk_hits = hits;
+    out.disk_misses = misses;
+    out.disk_bytes = bytes;
+}
@@ -0,0 +1,214 @@
+#ifndef POLY_CACHE_H
+#define POLY_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "poly.h"
+
+enum class cache_op : uint8_t
+{
+    multiply,
+    remainder
+};
+
+/**
+ * @brief A secret 128-bit key for the cache's keyed hash.
+ */
+struct hash_key
+{
+    uint64_t k0;
+    uint64_t k1;
+
+    /**
+     * @brief A fresh key drawn from std::random_device.
+     */
+    static hash_key random();
+};
+
+/**
+ * @brief Incremental SipHash-2-4 with a 128-bit output, fed whole 64-bit words.
+ *
+ * Cache keys are built from this rather than from the additive
+ * polynomial::hash(): that digest is linear in the terms, so anyone choosing
+ * operands can solve for two different polynomials with the same value, and a
+ * cache hit on it alone would hand back the wrong product. Without the key
+ * nobody can predict the output, let alone aim two inputs at the same one.
+ */
+class keyed_hasher
+{
+public:
+    explicit keyed_hasher(const hash_key &key);
+
+    void add(uint64_t word);
+    content_hash finish();
+
+private:
+    void round();
+
+    uint64_t v0, v1, v2, v3;
+    uint64_t length;
+};
+
+/**
+ * @brief Identifies a cached result by operation and keyed operand hashes.
+ *
+ * a and b come from keyed_hasher over each operand's canonical terms, never
+ * from polynomial::hash().
+ */
+struct cache_key
+{
+    cache_op op;
+    content_hash a;
+    content_hash b;
+
+    bool operator==(const cache_key &other) const;
+};
+
+struct cache_key_hasher
+{
+    size_t operator()(const cache_key &key) const;
+};
+
+/**
+ * @brief A thread-safe LRU map from (operation, operand hashes) to results.
+ *
+ * Keys are spread over independently locked shards so concurrent callers
+ * rarely wait on each other. The shards share one bound on the number of
+ * result terms held, so a single entry may take the whole capacity; recency
+ * is tracked per shard, and an insert evicts from its own shard before the
+ * others. Concurrent inserts can overshoot the bound briefly.
+ */
+class result_cache
+{
+public:
+    /**
+     * @param capacity
+     *  The maximum number of result terms held across all shards
+     */
+    explicit result_cache(size_t capacity);
+
+    /**
+     * @brief Copies the cached result for key into out.
+     *
+     * @return true on a hit, false on a miss
+     */
+    bool lookup(const cache_key &key, polynomial &out);
+
+    /**
+     * @brief Stores value under key, evicting old entries as needed: the
+     *        least recently used of key's own shard first, then those of the
+     *        other shards in turn. Values heavier than the whole capacity
+     *        aren't stored.
+     *
+     * @param weight
+     *  The number of terms in value, counted against the capacity
+     */
+    void insert(const cache_key &key, const polynomial &value, size_t weight);
+
+    cache_stats stats() const;
+
+private:
+    static const size_t SHARDS = 16;
+
+    struct entry
+    {
+        cache_key key;
+        polynomial value;
+        size_t weight;
+    };
+
+    struct shard
+    {
+        std::mutex lock;
+        std::list<entry> order; // most recently used first
+        std::unordered_map<cache_key, std::list<entry>::iterator, cache_key_hasher> index;
+        size_t terms = 0;
+    };
+
+    shard &shard_for(const cache_key &key);
+
+    size_t capacity;
+    std::unique_ptr<shard[]> shards;
+    std::atomic<size_t> total_terms; // across every shard
+
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+};
+
+/**
+ * @brief An LRU result cache stored as one file per entry in a directory.
+ *
+ * Files are written under a temporary name and renamed into place, so readers
+ * (including other processes sharing the directory) never see partial
+ * entries. Lookups map the file read-only instead of copying it through a
+ * stream. The least recently used files are deleted once the total size
+ * would exceed the budget; recency survives restarts through file mtimes.
+ */
+class disk_cache
+{
+public:
+    /**
+     * @param directory
+     *  The directory holding the cache files, created if it doesn't exist
+     * @param max_bytes
+     *  The maximum total size of the cache files
+     * @param min_cost
+     *  The smallest product of operand term counts worth a file
+     */
+    disk_cache(const std::string &directory, size_t max_bytes, size_t min_cost);
+
+    /**
+     * @brief Whether an operation on operands with these term counts is
+     *        expensive enough to look up and store on disk.
+     */
+    bool worth_storing(size_t a_terms, size_t b_terms) const;
+
+    bool lookup(const cache_key &key, polynomial &out);
+    void insert(const cache_key &key, const polynomial &value);
+
+    /**
+     * @brief The hash key shared by every process using this directory.
+     *
+     * Kept in a ".key" file created on first use, so file names stay stable
+     * across runs but can't be predicted without read access to the directory.
+     */
+    const hash_key &secret() const;
+
+    /**
+     * @brief Fills in the disk_ fields of out.
+     */
+    void stats(cache_stats &out);
+
+private:
+    struct file
+    {
+        std::list<std::string>::iterator position;
+        size_t bytes;
+    };
+
+    static std::string name_for(const cache_key &key);
+    void forget(const std::string &name);
+
+    std::string directory;
+    size_t max_bytes;
+    size_t min_cost;
+    hash_key secret_key;
+
+    std::mutex lock;
+    std::list<std::string> order; // most recently used first
+    std::unordered_map<std::string, file> files;
+    size_t bytes;
+    uint64_t temp_files;
+
+    uint64_t hits;
+    uint64_t misses;
+};
+
+#endif
@@ -0,0 +1,381 @@
+#include "poly_dense.h"
+#include "poly_ntt.h"
+#include "poly_fft.h"
+#include <algorithm>
+
+// below this length Karatsuba's extra additions cost more than they save
+static const size_t KARATSUBA_CUTOFF = 32;
+
+// from this shorter-operand length on the NTT beats Karatsuba
+static const size_t NTT_CUTOFF = 4096;
+
+// r[0, na+nb-1) += a * b
+static void schoolbook_add(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *r)
+{
+    for (size_t i = 0; i < na; i++)
+    {
+        uint32_t x = a[i];
+        for (size_t j = 0; j < nb; j++)
+        {
+            r[i + j] += x * b[j];
+        }
+    }
+}
+
+// r[0, na+nb-1) += a * b
+static void karatsuba_add(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, uint32_t *r)
+{
+    if (na < nb)
+    {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+
+    if (nb == 0)
+    {
+        return;
+    }
+
+    if (nb < KARATSUBA_CUTOFF)
+    {
+        schoolbook_add(a, na, b, nb, r);
+        return;
+    }
+
+    if (na > nb)
+    {
+        for (size_t i = 0; i < na; i += nb)
+        {
+            karatsuba_add(a + i, std::min(nb, na - i), b, nb, r + i);
+        }
+        return;
+    }
+
+    // a = a0 + a1 x^lo, b likewise
+    size_t n = na;
+    size_t lo = (n + 1) / 2;
+    size_t hi = n - lo;
+
+    // recursion scratch: many small short-lived buffers, so plain heap vectors
+    std::vector<uint32_t> sa(a, a + lo), sb(b, b + lo);
+    for (size_t i = 0; i < hi; i++)
+    {
+        sa[i] += a[lo + i];
+        sb[i] += b[lo + i];
+    }
+
+    std::vector<uint32_t> z0(2 * lo - 1, 0), z1(2 * lo - 1, 0), z2(hi == 0 ? 0 : 2 * hi - 1, 0);
+    karatsuba_add(a, lo, b, lo, z0.data());
+    karatsuba_add(a + lo, hi, b + lo, hi, z2.data());
+    karatsuba_add(sa.data(), lo, sb.data(), lo, z1.data());
+
+    for (size_t i = 0; i < z0.size(); i++)
+    {
+        z1[i] -= z0[i];
+        r[i] += z0[i];
+    }
+    for (size_t i = 0; i < z2.size(); i++)
+    {
+        z1[i] -= z2[i];
+        r[2 * lo + i] += z2[i];
+    }
+    for (size_t i = 0; i < z1.size(); i++)
+    {
+        r[lo + i] += z1[i];
+    }
+}
+
+dense_coeffs schoolbook_multiply(const dense_coeffs &a, const dense_coeffs &b)
+{
+    if (a.empty() || b.empty())
+    {
+        return {};
+    }
+
+    dense_coeffs r(a.size() + b.size() - 1, 0);
+    schoolbook_add(a.data(), a.size(), b.data(), b.size(), r.data());
+    return r;
+}
+
+dense_coeffs karatsuba_multiply(const dense_coeffs &a, const dense_coeffs &b)
+{
+    if (a.empty() || b.empty())
+    {
+        return {};
+    }
+
+    dense_coeffs r(a.size() + b.size() - 1, 0);
+    karatsuba_add(a.data(), a.size(), b.data(), b.size(), r.data());
+    return r;
+}
+
+dense_coeffs dense_multiply(const dense_coeffs &a, const dense_coeffs &b, int threads)
+{
+    size_t shorter = std::min(a.size(), b.size());
+
+    if (shorter < KARATSUBA_CUTOFF)
+    {
+        return schoolbook_multiply(a, b);
+    }
+    if (shorter >= NTT_CUTOFF)
+    {
+        dense_coeffs r;
+        if (fft_multiply(a, b, threads, r))
+        {
+            return r;
+        }
+        if (ntt_length(a.size() + b.size() - 1) != 0)
+        {
+            return ntt_multiply(a, b, threads);
+        }
+    }
+    return karatsuba_multiply(a, b);
+}
+
+// middle products
+
+// r[0, m) += the middle product of a[0, m + n - 1) and b[0, n)
+static void schoolbook_middle_add(const uint32_t *a, const uint32_t *b, size_t m, size_t n, uint32_t *r)
+{
+    for (size_t j = 0; j < n; j++)
+    {
+        uint32_t y = b[j];
+        const uint32_t *row = a + (n - 1 - j);
+        for (size_t k = 0; k < m; k++)
+        {
+            r[k] += row[k] * y;
+        }
+    }
+}
+
+// r[0, m) += the middle product of a[0, m + n - 1) and b[0, n)
+static void karatsuba_middle_add(const uint32_t *a, const uint32_t *b, size_t m, size_t n, uint32_t *r)
+{
+    if (m == 0 || n == 0)
+    {
+        return;
+    }
+
+    if (std::min(m, n) < KARATSUBA_CUTOFF)
+    {
+        schoolbook_middle_add(a, b, m, n, r);
+        return;
+    }
+
+    // more outputs than b: n outputs at a time
+    if (m > n)
+    {
+        for (size_t k = 0; k < m; k += n)
+        {
+            karatsuba_middle_add(a + k, b, std::min(n, m - k), n, r + k);
+        }
+        return;
+    }
+
+    // a longer b: m of its coefficients at a time, each against the part of
+    // a it meets
+    if (n > m)
+    {
+        for (size_t j = 0; j < n; j += m)
+        {
+            size_t len = std::min(m, n - j);
+            karatsuba_middle_add(a + (n - j - len), b + j, m, len, r);
+        }
+        return;
+    }
+
+    // odd n: b's top coefficient and the last output are done directly
+    if (n % 2 == 1)
+    {
+        uint32_t top = b[n - 1];
+        for (size_t k = 0; k + 1 < m; k++)
+        {
+            r[k] += a[k] * top;
+        }
+        for (size_t j = 0; j < n; j++)
+        {
+            r[m - 1] += a[m - 1 + n - 1 - j] * b[j];
+        }
+        karatsuba_middle_add(a + 1, b, m - 1, n - 1, r);
+        return;
+    }
+
+    // b = b0 + b1 x^h against the overlapping thirds a0, a1, a2 of a:
+    //  low  = mp(a1, b0) + mp(a0, b1) = mp(a0 + a1, b1) + mp(a1, b0 - b1)
+    //  high = mp(a2, b0) + mp(a1, b1) = mp(a1 + a2, b0) - mp(a1, b0 - b1)
+    size_t h = n / 2;
+    std::vector<uint32_t> s01(2 * h - 1), s12(2 * h - 1), db(h);
+    for (size_t i = 0; i < 2 * h - 1; i++)
+    {
+        s01[i] = a[i] + a[h + i];
+        s12[i] = a[h + i] + a[2 * h + i];
+    }
+    for (size_t i = 0; i < h; i++)
+    {
+        db[i] = b[i] - b[h + i];
+    }
+
+    std::vector<uint32_t> alpha(h, 0), beta(h, 0), gamma(h, 0);
+    karatsuba_middle_add(s01.data(), b + h, h, h, alpha.data());
+    karatsuba_middle_add(a + h, db.data(), h, h, beta.data());
+    karatsuba_middle_add(s12.data(), b, h, h, gamma.data());
+
+    for (size_t i = 0; i < h; i++)
+    {
+        r[i] += alpha[i] + beta[i];
+        r[h + i] += gamma[i] - beta[i];
+    }
+}
+
+dense_coeffs schoolbook_middle_product(const dense_coeffs &a, const dense_coeffs &b)
+{
+    if (b.empty() || a.size() < b.size())
+    {
+        return {};
+    }
+
+    dense_coeffs r(a.size() - b.size() + 1, 0);
+    schoolbook_middle_add(a.data(), b.data(), r.size(), b.size(), r.data());
+    return r;
+}
+
+dense_coeffs karatsuba_middle_product(const dense_coeffs &a, const dense_coeffs &b)
+{
+    if (b.empty() || a.size() < b.size())
+    {
+        return {};
+    }
+
+    dense_coeffs r(a.size() - b.size() + 1, 0);
+    karatsuba_middle_add(a.data(), b.data(), r.size(), b.size(), r.data());
+    return r;
+}
+
+dense_coeffs dense_middle_product(const dense_coeffs &a, const dense_coeffs &b, int threads)
+{
+    if (b.empty() || a.size() < b.size())
+    {
+        return {};
+    }
+
+    size_t shorter = std::min(a.size() - b.size() + 1, b.size());
+
+    if (shorter < KARATSUBA_CUTOFF)
+    {
+        return schoolbook_middle_product(a, b);
+    }
+    if (shorter >= NTT_CUTOFF && ntt_length(a.size()) != 0)
+    {
+        return ntt_middle_product(a, b, threads);
+    }
+    return karatsuba_middle_product(a, b);
+}
+
+dense_coeffs transposed_multiply(const dense_coeffs &b, const dense_coeffs &c, int threads)
+{
+    return dense_middle_product(c, dense_coeffs(b.rbegin(), b.rend()), threads);
+}
+
+// division
+
+static dense_coeffs reversed(const dense_coeffs &a, size_t length)
+{
+    dense_coeffs r(length, 0);
+    for (size_t i = 0; i < std::min(length, a.size()); i++)
+    {
+        r[length - 1 - i] = a[i];
+    }
+    return r;
+}
+
+dense_coeffs inverse_series(const dense_coeffs &f, size_t n, int threads)
+{
+    // f[0] is 1 or -1, its own inverse
+    dense_coeffs g = {f[0]};
+
+    for (size_t prec = 1; prec < n;)
+    {
+        size_t known = prec;
+        prec = std::min(2 * prec, n);
+
+        // f g = 1 + x^known e mod x^prec, where e = (f g)[known, prec) is the
+        // middle product of f[1, prec) and g
+        dense_coeffs ft(prec - 1, 0);
+        for (size_t i = 1; i < std::min(prec, f.size()); i++)
+        {
+            ft[i - 1] = f[i];
+        }
+        dense_coeffs e = dense_middle_product(ft, g, threads);
+
+        // g (2 - f g) = g - x^known (g e)
+        dense_coeffs ge = dense_multiply(g, e, threads);
+        g.resize(prec, 0);
+        for (size_t i = 0; i < prec - known; i++)
+        {
+            g[known + i] -= ge[i];
+        }
+    }
+
+    g.resize(n, 0);
+    return g;
+}
+
+// a mod x^n - 1, in n coefficients
+static dense_coeffs folded(const dense_coeffs &a, size_t n)
+{
+    dense_coeffs r(n, 0);
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        r[i % n] += a[i];
+    }
+    return r;
+}
+
+dense_coeffs dense_remainder(const dense_coeffs &a, const dense_coeffs &d, int threads)
+{
+    size_t n = d.size() - 1; // deg d
+    if (a.size() <= n)
+    {
+        dense_coeffs r(a);
+        r.resize(n, 0);
+        return r;
+    }
+
+    size_t m = a.size() - 1; // deg a
+    size_t k = m - n + 1;    // quotient length
+
+    // rev(q) = rev(a) rev(d)^-1 mod x^k needs only the top k coefficients of a
+    dense_coeffs top(k);
+    for (size_t i = 0; i < k; i++)
+    {
+        top[i] = a[m - i];
+    }
+    dense_coeffs q = dense_multiply(top, inverse_series(reversed(d, n + 1), k, threads), threads);
+    q.resize(k, 0);
+    q = reversed(q, k);
+
+    // a - q d has degree below n, so it is the same mod x^N - 1 for any N >= n:
+    // long operands take one cyclic product of length N, short ones multiply
+    // just the low n coefficients of q and d
+    dense_coeffs r(n, 0);
+    size_t N = ntt_length(n);
+    if (std::min(k, n) >= NTT_CUTOFF && N != 0 && ntt_cyclic_supported(N, false))
+    {
+        dense_coeffs qd = ntt_multiply_cyclic(folded(q, N), folded(d, N), false, threads);
+        dense_coeffs af = folded(a, N);
+        for (size_t i = 0; i < n; i++)
+        {
+            r[i] = af[i] - qd[i];
+        }
+        return r;
+    }
+
+    dense_coeffs q_low(q.begin(), q.begin() + std::min(k, n));
+    dense_coeffs d_low(d.begin(), d.begin() + n);
+    dense_coeffs qd = dense_multiply(q_low, d_low, threads);
+    for (size_t i = 0; i < n; i++)
+    {
+        r[i] = a[i] - (i < qd.size() ? qd[i] : 0);
+    }
+    return r;
+}
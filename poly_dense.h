@@ -0,0 +1,117 @@
+#ifndef POLY_DENSE_H
+#define POLY_DENSE_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "poly_alloc.h"
+
+/**
+ * Dense coefficient vectors: index i holds the coefficient of x^i. Entries are
+ * the bits of a coeff, so signed values wrap exactly like int arithmetic.
+ * Storage is 64-byte aligned, and on huge pages when large.
+ */
+using dense_coeffs = buffer<uint32_t>;
+
+/**
+ * @brief Quadratic product, for short operands.
+ *
+ * @return dense_coeffs
+ *  a.size() + b.size() - 1 coefficients (none if either is empty)
+ */
+dense_coeffs schoolbook_multiply(const dense_coeffs &a, const dense_coeffs &b);
+
+/**
+ * @brief Karatsuba product. Exact mod 2^32, since it only adds, subtracts
+ *        and multiplies. Unbalanced operands are sliced into blocks the size
+ *        of the shorter one.
+ *
+ * @return dense_coeffs
+ *  a.size() + b.size() - 1 coefficients (none if either is empty)
+ */
+dense_coeffs karatsuba_multiply(const dense_coeffs &a, const dense_coeffs &b);
+
+/**
+ * @brief Multiplies with whichever dense kernel (schoolbook, Karatsuba,
+ *        FFT or NTT) is cheapest for these lengths. Long products try the
+ *        FFT first and use the NTT where its error bound fails.
+ *
+ * @param threads
+ *  The maximum number of threads the transforms may use
+ * @return dense_coeffs
+ *  a.size() + b.size() - 1 coefficients (none if either is empty)
+ */
+dense_coeffs dense_multiply(const dense_coeffs &a, const dense_coeffs &b, int threads);
+
+/**
+ * @brief Middle products: with n = b.size() and a.size() = m + n - 1, these
+ *        return the m coefficients n - 1 .. m + n - 2 of a * b, the ones where
+ *        b overlaps a completely. For m = n that is the middle third of a
+ *        (2n - 1) x n product, at the cost of an n x n one.
+ *
+ * The Karatsuba version is the transposed algorithm: three half-size middle
+ * products instead of four. The NTT version uses a cyclic transform only as
+ * long as a, since wrap-around lands on the coefficients that are dropped.
+ *
+ * @return dense_coeffs
+ *  m coefficients (none if b is empty or longer than a)
+ */
+dense_coeffs schoolbook_middle_product(const dense_coeffs &a, const dense_coeffs &b);
+dense_coeffs karatsuba_middle_product(const dense_coeffs &a, const dense_coeffs &b);
+
+/**
+ * @brief Takes a middle product with whichever kernel (schoolbook, Karatsuba
+ *        or NTT) is cheapest for these lengths.
+ *
+ * @param threads
+ *  The maximum number of threads the NTT may use
+ */
+dense_coeffs dense_middle_product(const dense_coeffs &a, const dense_coeffs &b, int threads);
+
+/**
+ * @brief The transpose of multiplication by b: maps c, of length m + n - 1,
+ *        to out[i] = sum over j of b[j] c[i + j], of length m. It is the
+ *        middle product of c with b reversed.
+ *
+ * @param threads
+ *  The maximum number of threads the NTT may use
+ * @return dense_coeffs
+ *  c.size() - b.size() + 1 coefficients (none if b is empty or longer than c)
+ */
+dense_coeffs transposed_multiply(const dense_coeffs &b, const dense_coeffs &c, int threads);
+
+/**
+ * @brief Returns g with f * g = 1 mod x^n, by Newton iteration
+ *        g <- g (2 - f g). f[0] must be 1 or -1 (as a coeff). The low half
+ *        of f g is already known to be 1, so each step only takes the middle
+ *        product for its top half.
+ *
+ * @param threads
+ *  The maximum number of threads the products may use
+ * @return dense_coeffs
+ *  n coefficients
+ */
+dense_coeffs inverse_series(const dense_coeffs &f, size_t n, int threads);
+
+/**
+ * @brief Returns a mod d in O(M(n)) via the reversed-quotient identity
+ *        rev(q) = rev(a) / rev(d) mod x^(deg a - deg d + 1), which reads only
+ *        the top deg a - deg d + 1 coefficients of a. Since a - q d has degree
+ *        below deg d, q d is only needed mod x^deg d (a short product) or mod
+ *        x^N - 1 for an NTT length N >= deg d (one cyclic product). The
+ *        leading coefficient of d must be 1 or -1 (as a coeff), which makes
+ *        the result the same as the long division in operator%.
+ *
+ * @param a
+ *  The dividend
+ * @param d
+ *  The divisor, with no zero leading coefficients
+ * @param threads
+ *  The maximum number of threads the products may use
+ * @return dense_coeffs
+ *  deg d coefficients (the remainder padded with zeros)
+ */
+dense_coeffs dense_remainder(const dense_coeffs &a, const dense_coeffs &d, int threads);
+
+#endif
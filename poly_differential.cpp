@@ -0,0 +1,250 @@
+#include "poly_differential.h"
+#include "poly_ntt.h"
+#include "poly_tree.h"
+#include <map>
+#include <stdexcept>
+
+/** Straightforward reference results, computed with wrapping 32-bit arithmetic */
+static form reference_form(const std::map<power, uint32_t, std::greater<power>> &acc)
+{
+    form out;
+    for (auto &t : acc)
+    {
+        if (t.second != 0)
+        {
+            out.push_back({t.first, static_cast<coeff>(t.second)});
+        }
+    }
+    if (out.empty())
+    {
+        out.push_back({0, 0});
+    }
+    return out;
+}
+
+static form reference_multiply(const form &a, const form &b)
+{
+    std::map<power, uint32_t, std::greater<power>> acc;
+    for (auto &at : a)
+    {
+        for (auto &bt : b)
+        {
+            acc[at.first + bt.first] += static_cast<uint32_t>(at.second) * static_cast<uint32_t>(bt.second);
+        }
+    }
+    return reference_form(acc);
+}
+
+static form reference_add(const form &a, const form &b, coeff scale)
+{
+    std::map<power, uint32_t, std::greater<power>> acc;
+    for (auto &t : a)
+    {
+        acc[t.first] += static_cast<uint32_t>(t.second);
+    }
+    for (auto &t : b)
+    {
+        acc[t.first] += static_cast<uint32_t>(t.second) * static_cast<uint32_t>(scale);
+    }
+    return reference_form(acc);
+}
+
+/** Long division by a divisor with leading coefficient 1 */
+static form reference_remainder(const form &a, const form &d)
+{
+    std::map<power, uint32_t, std::greater<power>> acc;
+    for (auto &t : a)
+    {
+        acc[t.first] += static_cast<uint32_t>(t.second);
+    }
+
+    const power top = d[0].first;
+    while (!acc.empty() && acc.begin()->first >= top)
+    {
+        const power shift = acc.begin()->first - top;
+        const uint32_t q = acc.begin()->second;
+        for (auto &t : d)
+        {
+            auto it = acc.emplace(t.first + shift, 0).first;
+            it->second -= q * static_cast<uint32_t>(t.second);
+            if (it->second == 0)
+            {
+                acc.erase(it);
+            }
+        }
+    }
+    return reference_form(acc);
+}
+
+/** The product folded modulo x^n - 1, or x^n + 1 if negacyclic */
+static form reference_wrapped(const form &product, size_t n, bool negacyclic)
+{
+    std::map<power, uint32_t, std::greater<power>> acc;
+    for (auto &t : product)
+    {
+        uint32_t c = static_cast<uint32_t>(t.second);
+        acc[static_cast<power>(t.first % n)] += negacyclic && (t.first / n) % 2 ? 0u - c : c;
+    }
+    return reference_form(acc);
+}
+
+/** Reads up to count terms from the fuzz input, advancing data */
+static form decode_terms(const uint8_t *&data, const uint8_t *end, size_t count, power max_power)
+{
+    form out;
+    while (count-- > 0 && end - data >= 6)
+    {
+        power p = (data[0] | (data[1] << 8)) % (max_power + 1);
+        coeff c = static_cast<coeff>(data[2] | (data[3] << 8) | (data[4] << 16) | (static_cast<uint32_t>(data[5]) << 24));
+        if (data[2] & 1)
+        {
+            c %= 1000; // mostly small coefficients, so the division loop stays short
+        }
+        out.push_back({p, c});
+        data += 6;
+    }
+    return out;
+}
+
+/** Checks p^n through every pow_engine; miller may refuse a base it can't bound */
+static bool pow_case(const polynomial &p, unsigned int n)
+{
+    form expected = {{0, 1}};
+    for (unsigned int i = 0; i < n; i++)
+    {
+        expected = reference_multiply(expected, p.canonical_form());
+    }
+
+    bool ok = p.pow(n).canonical_form() == expected;
+    ok = ok && p.pow(n, pow_engine::automatic).canonical_form() == expected;
+    ok = ok && p.pow(n, pow_engine::squaring).canonical_form() == expected;
+    try
+    {
+        ok = ok && p.pow(n, pow_engine::miller).canonical_form() == expected;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+    return ok;
+}
+
+bool differential_case(const uint8_t *data, size_t size)
+{
+    const uint8_t *end = data + size;
+    if (size < 6)
+    {
+        return true;
+    }
+
+    size_t na = data[0] % 64;
+    size_t nb = data[1] % 64;
+    power max_power = 1 + (data[2] % 2 ? 4096 : 64);
+    coeff scale = static_cast<int8_t>(data[3]);
+    unsigned int exponent = data[4] % 16;
+    // ring sizes: anything up to 128 (so 1 and non-smooth n), or 2^k, 3 * 2^k, 5 * 2^k
+    size_t ring = data[5] < 128 ? 1 + data[5] : size_t(1 + 2 * ((data[5] / 8) % 3)) << (4 + data[5] % 8);
+    data += 6;
+
+    form a_terms = decode_terms(data, end, na, max_power);
+    form b_terms = decode_terms(data, end, nb, max_power);
+
+    polynomial a(a_terms.begin(), a_terms.end());
+    polynomial b(b_terms.begin(), b_terms.end());
+
+    form expected_product = reference_multiply(a.canonical_form(), b.canonical_form());
+    form cyclic = reference_wrapped(expected_product, ring, false);
+    form negacyclic = reference_wrapped(expected_product, ring, true);
+
+    const int saved_threads = polynomial::max_threads();
+    const size_t saved_cutoff = ntt_six_step_cutoff();
+    bool ok = true;
+
+    for (int threads : {1, 2, 3, 8})
+    {
+        polynomial::set_max_threads(threads);
+
+        ok = ok && (a * b).canonical_form() == expected_product;
+        for (mult_engine engine : polynomial::engines())
+        {
+            ok = ok && a.multiply(b, engine).canonical_form() == expected_product;
+            ok = ok && b.multiply(a, engine).canonical_form() == expected_product;
+        }
+
+        // the six-step path normally needs 2^20-point transforms; force it down
+        for (size_t cutoff : {saved_cutoff, size_t(64)})
+        {
+            polynomial::set_six_step_cutoff(cutoff);
+            ok = ok && a.multiply(b, mult_engine::ntt).canonical_form() == expected_product;
+            ok = ok && a.multiply_cyclic(b, ring).canonical_form() == cyclic;
+            ok = ok && a.multiply_negacyclic(b, ring).canonical_form() == negacyclic;
+        }
+        polynomial::set_six_step_cutoff(saved_cutoff);
+    }
+
+    polynomial::set_max_threads(saved_threads);
+
+    ok = ok && (a + b).canonical_form() == reference_add(a.canonical_form(), b.canonical_form(), 1);
+    ok = ok && (a * scale).canonical_form() == reference_add({{0, 0}}, a.canonical_form(), scale);
+    ok = ok && (scale * a + b).canonical_form() == reference_add(b.canonical_form(), a.canonical_form(), scale);
+    ok = ok && (a + scale).canonical_form() == reference_add(a.canonical_form(), {{0, 1}}, scale);
+
+    // a short base with small coefficients, which the Miller recurrence accepts,
+    // and a low power of the whole of a, which it mostly doesn't
+    form h_terms;
+    for (auto &t : a.canonical_form())
+    {
+        if (h_terms.size() < 3)
+        {
+            h_terms.push_back({t.first, t.second % 3});
+        }
+    }
+    ok = ok && pow_case(polynomial(h_terms.begin(), h_terms.end()), exponent);
+    ok = ok && pow_case(a, exponent % 3);
+
+    // only monic divisors: the truncating division loop can't make progress otherwise
+    form d_terms = b.canonical_form();
+    d_terms[0].second = 1;
+    polynomial d(d_terms.begin(), d_terms.end());
+
+    polynomial r = a % d;
+    ok = ok && r.canonical_form() == reference_remainder(a.canonical_form(), d_terms);
+    ok = ok && r == a.remainder(d, cache_policy::bypass);
+    ok = ok && r == (a + d * b) % d;
+
+    // a two-leaf tree: d and x + scale
+    form m_terms = {{1, 1}, {0, scale}};
+    polynomial m(m_terms.begin(), m_terms.end());
+    product_tree moduli({d, m});
+    ok = ok && moduli.root() == d * m;
+    ok = ok && product({a, b, d}) == a * b * d;
+
+    std::vector<polynomial> residues = remainders(a, moduli);
+    ok = ok && residues.size() == 2 && residues[0] == r;
+    ok = ok && residues[1].canonical_form() == reference_remainder(a.canonical_form(), m_terms);
+
+    // both moduli are monic, so chinese_remainder() may only refuse them when
+    // they share a factor mod 2: x + scale is x or x + 1 there, so exactly
+    // when d vanishes mod 2 at x = scale mod 2
+    uint32_t d_at_root = 0;
+    for (auto &t : d_terms)
+    {
+        if (scale % 2 != 0 || t.first == 0)
+        {
+            d_at_root += static_cast<uint32_t>(t.second);
+        }
+    }
+    const bool coprime = d_at_root % 2 != 0;
+
+    try
+    {
+        polynomial f = chinese_remainder(residues, moduli);
+        ok = ok && f % d == residues[0] && f % m == residues[1];
+        ok = ok && (f == polynomial() || f.canonical_form()[0].first < moduli.root().canonical_form()[0].first);
+    }
+    catch (const std::runtime_error &)
+    {
+        ok = ok && !coprime;
+    }
+
+    return ok;
+}
@@ -0,0 +1,29 @@
+#ifndef POLY_DIFFERENTIAL_H
+#define POLY_DIFFERENTIAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "poly.h"
+
+using form = std::vector<std::pair<power, coeff>>;
+
+/**
+ * Runs one differential case decoded from raw bytes against straightforward
+ * reference results, computed with wrapping 32-bit arithmetic:
+ *  - the product through every engine and thread limit, with the six-step
+ *    NTT both at its default cutoff and forced on for small lengths,
+ *  - cyclic and negacyclic products for a ring size taken from the input,
+ *  - pow() through every pow_engine that accepts the base,
+ *  - % through the cache and without it, and remainders() and
+ *    chinese_remainder() over a small product tree,
+ *  - + and scalar *.
+ * Shared by main.cpp's differential test and the poly_fuzz.cpp fuzz target.
+ *
+ * Returns false on any mismatch.
+ */
+bool differential_case(const uint8_t *data, size_t size);
+
+#endif
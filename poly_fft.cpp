@@ -0,0 +1,325 @@
+#include "poly_fft.h"
+#include "poly_thread.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using complex = std::complex<double>;
+using spectrum = buffer<complex>;
+
+// longest transform tried; its root table alone takes 256 MB
+static const size_t FFT_MAX_LENGTH = size_t(1) << 24;
+
+static const double PI = 3.14159265358979323846;
+
+// plain complex product, without std::complex's inf/NaN handling
+static inline complex mul(complex x, complex y)
+{
+    return complex(x.real() * y.real() - x.imag() * y.imag(), x.real() * y.imag() + x.imag() * y.real());
+}
+
+// e^(-i pi j / h) for h = 1, 2, 4, .., n / 2 and j < h, level after level
+// (n - 1 in all), each from cos and sin directly so the error doesn't grow
+// along the table. As with the NTT twiddles, the longest table serves every
+// shorter length and is shared between calls and threads.
+static std::shared_ptr<const std::vector<complex>> root_plan(size_t n)
+{
+    static std::shared_ptr<const std::vector<complex>> plan;
+    static std::mutex lock;
+
+    auto current = std::atomic_load(&plan);
+    if (current && current->size() + 1 >= n)
+    {
+        return current;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    current = std::atomic_load(&plan);
+    if (current && current->size() + 1 >= n)
+    {
+        return current;
+    }
+
+    std::vector<complex> roots(n - 1);
+    for (size_t half = 1; half < n; half <<= 1)
+    {
+        for (size_t j = 0; j < half; j++)
+        {
+            double angle = -PI * static_cast<double>(j) / static_cast<double>(half);
+            roots[half - 1 + j] = complex(std::cos(angle), std::sin(angle));
+        }
+    }
+
+    current = std::make_shared<const std::vector<complex>>(std::move(roots));
+    std::atomic_store(&plan, current);
+    return current;
+}
+
+void fft_warm_up(size_t max_length)
+{
+    size_t n = 2;
+    while (n < std::min(max_length, FFT_MAX_LENGTH))
+    {
+        n <<= 1;
+    }
+    root_plan(n);
+}
+
+// in-place iterative radix-2 forward transform
+static void fft(spectrum &a, const complex *roots)
+{
+    size_t n = a.size();
+
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j)
+        {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    for (size_t half = 1; half < n; half <<= 1)
+    {
+        const complex *level = roots + (half - 1);
+        for (size_t i = 0; i < n; i += 2 * half)
+        {
+            for (size_t j = 0; j < half; j++)
+            {
+                complex u = a[i + j];
+                complex v = mul(a[i + j + half], level[j]);
+                a[i + j] = u + v;
+                a[i + j + half] = u - v;
+            }
+        }
+    }
+}
+
+// the inverse, unscaled: conj(fft(conj(a)))
+static void inverse_fft(spectrum &a, const complex *roots)
+{
+    for (auto &x : a)
+    {
+        x = std::conj(x);
+    }
+    fft(a, roots);
+    for (auto &x : a)
+    {
+        x = std::conj(x);
+    }
+}
+
+// x = d0 + d1 2^11 + d2 2^22 (mod 2^32) with every digit in [-1024, 1024)
+static void split(uint32_t x, double *d)
+{
+    int64_t rest = x;
+    for (int i = 0; i < 3; i++)
+    {
+        int64_t digit = rest & 2047;
+        if (digit >= 1024)
+        {
+            digit -= 2048;
+        }
+        d[i] = static_cast<double>(digit);
+        rest = (rest - digit) >> 11;
+    }
+    // the top digit carries 2^22 weight, so 1024 of it is 2^32 = 0
+    if (d[2] >= 512)
+    {
+        d[2] -= 1024;
+    }
+}
+
+// A worst-case bound on |computed - exact| for every coefficient of c0, c1 and
+// c2, in the style of Higham, "Accuracy and Stability of Numerical
+// Algorithms", ch. 24. u = 2^-53, N = n = 2^k, and |.| is the 2-norm unless
+// marked inf. P, Q, R are the norms of p, q, r, so |a0|, |a1| <= P,
+// |a2|, |b2| <= Q and |b0|, |b1| <= R.
+//
+// 1. Roots: the angle -PI j / h is off by at most 2 pi u (PI itself and one
+//    rounding), and cos and sin are within 1 ulp (u, below 1), as glibc's
+//    are. So each root is off by mu <= (2 pi + sqrt 2) u < 8 u.
+// 2. Forward transforms (Higham, Theorem 24.2): with eta = mu + g4 (sqrt 2
+//    + mu), g4 = 4u / (1 - 4u), the computed P^ has |P^ - P| <= phi |P| =
+//    phi sqrt(N) |p|, phi = k eta / (1 - k eta).
+// 3. Unpacking: A0 and A1 are halves of P and of its conjugate reversal, a
+//    split with |A0|^2 + |A1|^2 = |P|^2, so they inherit P's error; the one
+//    addition adds u |A|, and the halving is exact. Each A^ and B^ is within
+//    phi1 sqrt(N) of its norm bound, phi1 = phi + u (1 + phi).
+// 4. Pointwise: |X^ Y^ - X Y| <= |dX| |Y|inf + |X|inf |dY| + |dX| |dY|inf,
+//    and |X|inf <= |x|_1 <= sqrt(N) |x|, so each product is off by at most
+//    N nx ny (2 phi1 + phi1^2). The products round within sqrt 5 u each
+//    (Brent, Percival and Zimmermann) and are summed (with the c0 + i c1
+//    packing) in at most two additions, which costs g = (1 + sqrt 5 u)
+//    (1 + u)^2 - 1 of the sum of |X^ Y^| <= N nx ny (1 + phi1)^2. U = c0 + i c1
+//    sums three such products of size P R, V = c2 has P Q + P R + Q R.
+// 5. Inverse: F* has norm sqrt(N) and rounds within phi sqrt(N) |U^|, and
+//    |x|inf <= |x|, so after the exact scaling by 1/N each output is off by
+//    at most (|dU| + phi |U^|) / sqrt(N) =
+//    sqrt(N) S (2 phi1 + phi1^2 + (1 + phi1)^2 g + (1 + phi1)^2 (1 + g) phi),
+//    with S = 3 P R for c0 and c1 and S = P Q + P R + Q R for c2.
+//
+// Every exact coefficient is an integer, so llround() recovers it while this
+// stays below 1/2; fft_multiply() stops at 0.49 to leave room for the
+// rounding in evaluating the bound itself.
+static double error_bound(size_t n, double p, double q, double r)
+{
+    const double u = std::ldexp(1.0, -53);
+    const double k = std::log2(static_cast<double>(n));
+    const double mu = 8 * u;
+    const double g4 = 4 * u / (1 - 4 * u);
+    const double eta = mu + g4 * (std::sqrt(2.0) + mu);
+    if (k * eta >= 1)
+    {
+        return HUGE_VAL;
+    }
+
+    const double phi = k * eta / (1 - k * eta);
+    const double phi1 = phi + u * (1 + phi);
+    const double g = (1 + std::sqrt(5.0) * u) * (1 + u) * (1 + u) - 1;
+    const double grown = (1 + phi1) * (1 + phi1);
+    const double relative = 2 * phi1 + phi1 * phi1 + grown * g + grown * (1 + g) * phi;
+
+    const double s = std::max(3 * p * r, p * q + p * r + q * r);
+    return std::sqrt(static_cast<double>(n)) * s * relative;
+}
+
+// adds the squared norms of x's low two digits to low and of its top digit to top
+static void squared_norms(const dense_coeffs &x, double &low, double &top)
+{
+    for (uint32_t c : x)
+    {
+        double d[3];
+        split(c, d);
+        low += d[0] * d[0] + d[1] * d[1];
+        top += d[2] * d[2];
+    }
+}
+
+bool fft_multiply(const dense_coeffs &a, const dense_coeffs &b, int threads, dense_coeffs &out)
+{
+    if (a.empty() || b.empty())
+    {
+        out.clear();
+        return true;
+    }
+
+    size_t length = a.size() + b.size() - 1;
+    size_t n = 2;
+    while (n < length)
+    {
+        n <<= 1;
+    }
+    if (n > FFT_MAX_LENGTH)
+    {
+        return false;
+    }
+
+    // the bound needs only the digit norms, so check it before allocating
+    // or touching any of the 48 n bytes the transforms take
+    double norm_p = 0, norm_q = 0, norm_r = 0; // squared; sums of integers below 2^53, so exact
+    squared_norms(a, norm_p, norm_q);
+    squared_norms(b, norm_r, norm_q);
+
+    if (error_bound(n, std::sqrt(norm_p), std::sqrt(norm_q), std::sqrt(norm_r)) >= 0.49)
+    {
+        return false;
+    }
+
+    // p = a0 + i a1, q = a2 + i b2, r = b0 + i b1
+    spectrum p(n), q(n), r(n);
+    const size_t BLOCK = 1 << 12;
+
+    parallel_for((std::max(a.size(), b.size()) + BLOCK - 1) / BLOCK, threads, [&](size_t block)
+    {
+        size_t end = std::min(std::max(a.size(), b.size()), (block + 1) * BLOCK);
+        for (size_t i = block * BLOCK; i < end; i++)
+        {
+            double da[3] = {0, 0, 0}, db[3] = {0, 0, 0};
+            if (i < a.size())
+            {
+                split(a[i], da);
+            }
+            if (i < b.size())
+            {
+                split(b[i], db);
+            }
+            p[i] = complex(da[0], da[1]);
+            q[i] = complex(da[2], db[2]);
+            r[i] = complex(db[0], db[1]);
+        }
+    });
+
+    auto roots = root_plan(n);
+
+    parallel_for(3, threads, [&](size_t k)
+    {
+        fft(k == 0 ? p : (k == 1 ? q : r), roots->data());
+    });
+
+    // unpack the six real spectra from the three complex ones: for
+    // X = fft(x + i y), fft(x) = (X[k] + conj X[-k]) / 2 and
+    // fft(y) = (X[k] - conj X[-k]) / 2i. Then u = c0 + i c1 and v = c2.
+    spectrum u(n), v(n);
+
+    parallel_for((n + BLOCK - 1) / BLOCK, threads, [&](size_t block)
+    {
+        const complex half(0.5, 0), minus_half_i(0, -0.5);
+        size_t end = std::min(n, (block + 1) * BLOCK);
+
+        for (size_t k = block * BLOCK; k < end; k++)
+        {
+            size_t m = (n - k) & (n - 1);
+            complex pk = p[k], pm = std::conj(p[m]);
+            complex qk = q[k], qm = std::conj(q[m]);
+            complex rk = r[k], rm = std::conj(r[m]);
+
+            complex a0 = mul(pk + pm, half), a1 = mul(pk - pm, minus_half_i);
+            complex a2 = mul(qk + qm, half), b2 = mul(qk - qm, minus_half_i);
+            complex b0 = mul(rk + rm, half), b1 = mul(rk - rm, minus_half_i);
+
+            complex c0 = mul(a0, b0);
+            complex c1 = mul(a0, b1) + mul(a1, b0);
+            complex c2 = mul(a0, b2) + mul(a1, b1) + mul(a2, b0);
+
+            u[k] = c0 + complex(-c1.imag(), c1.real()); // c0 + i c1
+            v[k] = c2;
+        }
+    });
+
+    spectrum().swap(p);
+    spectrum().swap(q);
+    spectrum().swap(r);
+
+    parallel_for(2, threads, [&](size_t k)
+    {
+        inverse_fft(k == 0 ? u : v, roots->data());
+    });
+
+    out.assign(length, 0);
+    double scale = 1.0 / static_cast<double>(n);
+
+    parallel_for((length + BLOCK - 1) / BLOCK, threads, [&](size_t block)
+    {
+        size_t end = std::min(length, (block + 1) * BLOCK);
+        for (size_t i = block * BLOCK; i < end; i++)
+        {
+            uint32_t c0 = static_cast<uint32_t>(std::llround(u[i].real() * scale));
+            uint32_t c1 = static_cast<uint32_t>(std::llround(u[i].imag() * scale));
+            uint32_t c2 = static_cast<uint32_t>(std::llround(v[i].real() * scale));
+            out[i] = c0 + (c1 << 11) + (c2 << 22);
+        }
+    });
+
+    return true;
+}
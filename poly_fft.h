@@ -0,0 +1,43 @@
+#ifndef POLY_FFT_H
+#define POLY_FFT_H
+
+#include <cstddef>
+
+#include "poly_dense.h"
+
+/**
+ * @brief Computes a * b mod 2^32 per coefficient with double-precision
+ *        complex FFTs, if the rounding error bound allows it.
+ *
+ * Each coefficient is split into three balanced 11-bit digits, so
+ * x = x0 + x1 2^11 + x2 2^22 (mod 2^32). Digit products with i + j >= 3 are
+ * multiples of 2^33 and drop out, which leaves three digit convolutions:
+ * c0 = a0 b0, c1 = a0 b1 + a1 b0 and c2 = a0 b2 + a1 b1 + a2 b0. The six
+ * real inputs are packed two to a complex transform, and the two real outputs
+ * c0 and c1 share one inverse, so this takes five FFTs instead of nine.
+ *
+ * The result is only exact if every convolution coefficient is rounded to the
+ * right integer. Before transforming, the worst-case error is bounded from the
+ * digits' L2 norms and the transform length (a Higham-style bound, derived in
+ * poly_fft.cpp); if it could reach 1/2 this returns false and leaves out
+ * untouched, after one pass over a and b and before allocating anything, and
+ * the caller should use the exact NTT. The bound grows like
+ * n^1.5 log n: random coefficients of 10 bits or more pass up to products of
+ * about 2^15 coefficients, and only much smaller ones go further.
+ *
+ * @param threads
+ *  The maximum number of threads to use
+ * @param out
+ *  Receives a.size() + b.size() - 1 coefficients on success
+ * @return true if the product was computed
+ */
+bool fft_multiply(const dense_coeffs &a, const dense_coeffs &b, int threads, dense_coeffs &out);
+
+/**
+ * @brief Builds the root table for every product of up to max_length
+ *        coefficients now instead of on first use. The table is shared by all
+ *        later transforms and threads.
+ */
+void fft_warm_up(size_t max_length);
+
+#endif
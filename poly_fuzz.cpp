@@ -0,0 +1,23 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "poly_differential.h"
+
+/**
+ * libFuzzer entry point running one differential case per input, e.g.
+ *  clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address -pthread poly_fuzz.cpp
+ *      poly_differential.cpp poly.cpp poly_alloc.cpp poly_block.cpp
+ *      poly_cache.cpp poly_dense.cpp poly_fft.cpp poly_gf2.cpp
+ *      poly_incremental.cpp poly_ntt.cpp poly_online.cpp poly_thread.cpp
+ *      poly_tree.cpp
+ * A mismatch aborts, so the fuzzer records the input as a crash.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (!differential_case(data, size))
+    {
+        abort();
+    }
+    return 0;
+}
@@ -0,0 +1,473 @@
+#include "poly_gf2.h"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <immintrin.h>
+
+using words_t = std::vector<uint64_t>;
+
+// below this many words per operand Karatsuba costs more than it saves
+static const size_t KARATSUBA_WORDS = 16;
+
+// below this dividend degree plain shift-and-xor division is faster than Barrett
+static const size_t BARRETT_DEGREE = 256;
+
+static void normalize(words_t &w)
+{
+    while (!w.empty() && w.back() == 0)
+    {
+        w.pop_back();
+    }
+}
+
+static size_t degree_of(const words_t &w)
+{
+    return w.empty() ? 0 : 64 * (w.size() - 1) + 63 - __builtin_clzll(w.back());
+}
+
+// carry-less basecase kernels: r[0, na+nb) = a * b, r zeroed by the caller
+
+static void basecase_portable(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, uint64_t *r)
+{
+    for (size_t i = 0; i < na; i++)
+    {
+        for (size_t j = 0; j < nb; j++)
+        {
+            uint64_t x = a[i], y = b[j], lo = 0, hi = 0;
+            for (int k = 0; k < 64; k++)
+            {
+                if ((x >> k) & 1)
+                {
+                    lo ^= y << k;
+                    hi ^= k == 0 ? 0 : y >> (64 - k);
+                }
+            }
+            r[i + j] ^= lo;
+            r[i + j + 1] ^= hi;
+        }
+    }
+}
+
+__attribute__((target("pclmul,sse4.1")))
+static void basecase_pclmul(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, uint64_t *r)
+{
+    for (size_t i = 0; i < na; i++)
+    {
+        __m128i x = _mm_cvtsi64_si128(static_cast<long long>(a[i]));
+        for (size_t j = 0; j < nb; j++)
+        {
+            __m128i p = _mm_clmulepi64_si128(x, _mm_cvtsi64_si128(static_cast<long long>(b[j])), 0x00);
+            r[i + j] ^= static_cast<uint64_t>(_mm_cvtsi128_si64(p));
+            r[i + j + 1] ^= static_cast<uint64_t>(_mm_extract_epi64(p, 1));
+        }
+    }
+}
+
+// four word products per instruction pair; the tail of each row uses PCLMULQDQ
+__attribute__((target("vpclmulqdq,avx2,pclmul,sse4.1")))
+static void basecase_vpclmul(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, uint64_t *r)
+{
+    alignas(32) uint64_t even[4], odd[4];
+
+    for (size_t i = 0; i < na; i++)
+    {
+        __m256i x = _mm256_set1_epi64x(static_cast<long long>(a[i]));
+        size_t j = 0;
+
+        for (; j + 4 <= nb; j += 4)
+        {
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+            // lane 0 holds b[j], b[j+1] and lane 1 holds b[j+2], b[j+3]
+            _mm256_store_si256(reinterpret_cast<__m256i *>(even), _mm256_clmulepi64_epi128(x, y, 0x00));
+            _mm256_store_si256(reinterpret_cast<__m256i *>(odd), _mm256_clmulepi64_epi128(x, y, 0x10));
+
+            r[i + j] ^= even[0];
+            r[i + j + 1] ^= even[1] ^ odd[0];
+            r[i + j + 2] ^= odd[1] ^ even[2];
+            r[i + j + 3] ^= even[3] ^ odd[2];
+            r[i + j + 4] ^= odd[3];
+        }
+
+        if (j < nb)
+        {
+            basecase_pclmul(a + i, 1, b + j, nb - j, r + i + j);
+        }
+    }
+}
+
+using basecase_fn = void (*)(const uint64_t *, size_t, const uint64_t *, size_t, uint64_t *);
+
+static basecase_fn pick_basecase()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("vpclmulqdq") && __builtin_cpu_supports("avx2"))
+    {
+        return basecase_vpclmul;
+    }
+    if (__builtin_cpu_supports("pclmul"))
+    {
+        return basecase_pclmul;
+    }
+    return basecase_portable;
+}
+
+static const basecase_fn basecase = pick_basecase();
+
+// r[0, na+nb) ^= a * b
+static void mul_words(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, uint64_t *r)
+{
+    if (na < nb)
+    {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+
+    if (nb == 0)
+    {
+        return;
+    }
+
+    if (nb < KARATSUBA_WORDS)
+    {
+        basecase(a, na, b, nb, r);
+        return;
+    }
+
+    if (na > nb)
+    {
+        // unbalanced: slice a into nb-word blocks
+        for (size_t i = 0; i < na; i += nb)
+        {
+            mul_words(a + i, std::min(nb, na - i), b, nb, r + i);
+        }
+        return;
+    }
+
+    // Karatsuba, a = a0 + a1 X^lo with X = 2^64
+    size_t n = na;
+    size_t lo = (n + 1) / 2;
+    size_t hi = n - lo;
+
+    words_t sa(a, a + lo), sb(b, b + lo);
+    for (size_t i = 0; i < hi; i++)
+    {
+        sa[i] ^= a[lo + i];
+        sb[i] ^= b[lo + i];
+    }
+
+    words_t z0(2 * lo, 0), z1(2 * lo, 0), z2(2 * hi, 0);
+    mul_words(a, lo, b, lo, z0.data());
+    mul_words(a + lo, hi, b + lo, hi, z2.data());
+    mul_words(sa.data(), lo, sb.data(), lo, z1.data());
+
+    for (size_t i = 0; i < z0.size(); i++)
+    {
+        z1[i] ^= z0[i];
+        r[i] ^= z0[i];
+    }
+    for (size_t i = 0; i < z2.size(); i++)
+    {
+        z1[i] ^= z2[i];
+        r[2 * lo + i] ^= z2[i];
+    }
+    for (size_t i = 0; i < z1.size(); i++)
+    {
+        r[lo + i] ^= z1[i];
+    }
+}
+
+static words_t multiply(const words_t &a, const words_t &b)
+{
+    if (a.empty() || b.empty())
+    {
+        return {};
+    }
+
+    words_t r(a.size() + b.size(), 0);
+    mul_words(a.data(), a.size(), b.data(), b.size(), r.data());
+    normalize(r);
+    return r;
+}
+
+// keeps the coefficients of x^0 .. x^(bits-1)
+static void truncate(words_t &w, size_t bits)
+{
+    size_t n = (bits + 63) / 64;
+    if (w.size() > n)
+    {
+        w.resize(n);
+    }
+    if (n > 0 && w.size() == n && bits % 64 != 0)
+    {
+        w.back() &= (1ULL << (bits % 64)) - 1;
+    }
+    normalize(w);
+}
+
+static uint64_t reverse_bits(uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+// x^(bits-1) * w(1/x), for w of degree < bits
+static words_t reverse(const words_t &w, size_t bits)
+{
+    size_t n = (bits + 63) / 64;
+    words_t r(n, 0);
+    for (size_t i = 0; i < w.size() && i < n; i++)
+    {
+        r[n - 1 - i] = reverse_bits(w[i]);
+    }
+
+    // the reversed value sits in the top `bits` bits of n words; shift it down
+    size_t shift = 64 * n - bits;
+    if (shift != 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            r[i] = (r[i] >> shift) | (i + 1 < n ? r[i + 1] << (64 - shift) : 0);
+        }
+    }
+
+    normalize(r);
+    return r;
+}
+
+// g with f * g = 1 mod x^bits, for f(0) = 1; over GF(2) Newton's step is g <- f g^2
+static words_t inverse_series(const words_t &f, size_t bits)
+{
+    words_t g = {1};
+    for (size_t prec = 1; prec < bits;)
+    {
+        prec = std::min(2 * prec, bits);
+        words_t ft = f;
+        truncate(ft, prec);
+        words_t g2 = multiply(g, g);
+        truncate(g2, prec);
+        g = multiply(ft, g2);
+        truncate(g, prec);
+    }
+    return g;
+}
+
+static words_t long_remainder(words_t r, const words_t &d)
+{
+    size_t n = degree_of(d);
+    normalize(r);
+
+    while (!r.empty() && degree_of(r) >= n)
+    {
+        size_t shift = degree_of(r) - n;
+        size_t ws = shift / 64, bs = shift % 64;
+        for (size_t i = 0; i < d.size(); i++)
+        {
+            r[i + ws] ^= d[i] << bs;
+            if (bs != 0 && i + ws + 1 < r.size())
+            {
+                r[i + ws + 1] ^= d[i] >> (64 - bs);
+            }
+        }
+        normalize(r);
+    }
+
+    return r;
+}
+
+// gf2_polynomial member functions
+
+gf2_polynomial::gf2_polynomial()
+{
+}
+
+gf2_polynomial::gf2_polynomial(const gf2_polynomial &other)
+{
+    words = other.words;
+}
+
+gf2_polynomial &gf2_polynomial::operator=(const gf2_polynomial &other)
+{
+    if (this != &other)
+    {
+        words = other.words;
+    }
+    return *this;
+}
+
+template <typename Iter>
+gf2_polynomial::gf2_polynomial(Iter begin, Iter end)
+{
+    for (auto it = begin; it != end; it++)
+    {
+        if ((it->second & 1) == 0)
+        {
+            continue;
+        }
+
+        size_t w = it->first / 64;
+        if (words.size() <= w)
+        {
+            words.resize(w + 1, 0);
+        }
+        words[w] ^= 1ULL << (it->first % 64);
+    }
+    normalize(words);
+}
+
+template gf2_polynomial::gf2_polynomial(std::vector<std::pair<power, coeff>>::iterator, std::vector<std::pair<power, coeff>>::iterator);
+
+void gf2_polynomial::print() const
+{
+    for (auto &t : canonical_form())
+    {
+        std::cout << t.second << "x^" << t.first << std::endl;
+    }
+}
+
+content_hash gf2_polynomial::hash() const
+{
+    content_hash h{0, 0};
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        uint64_t x = words[i] ^ (i * 0x9e3779b97f4a7c15ULL);
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        h.lo += x ^ (x >> 31);
+        h.hi = (h.hi ^ words[i]) * 0xd6e8feb86659fd93ULL + i;
+    }
+    return h;
+}
+
+bool gf2_polynomial::operator==(const gf2_polynomial &other) const
+{
+    return words == other.words;
+}
+
+bool gf2_polynomial::operator!=(const gf2_polynomial &other) const
+{
+    return !(*this == other);
+}
+
+gf2_polynomial gf2_polynomial::operator+(const gf2_polynomial &other) const
+{
+    gf2_polynomial result(words.size() >= other.words.size() ? *this : other);
+    const words_t &small = words.size() >= other.words.size() ? other.words : words;
+
+    for (size_t i = 0; i < small.size(); i++)
+    {
+        result.words[i] ^= small[i];
+    }
+
+    normalize(result.words);
+    return result;
+}
+
+gf2_polynomial gf2_polynomial::operator+(int x) const
+{
+    gf2_polynomial result(*this);
+
+    if (x & 1)
+    {
+        if (result.words.empty())
+        {
+            result.words.push_back(0);
+        }
+        result.words[0] ^= 1;
+        normalize(result.words);
+    }
+
+    return result;
+}
+
+gf2_polynomial operator+(int x, const gf2_polynomial &p)
+{
+    return p + x;
+}
+
+gf2_polynomial gf2_polynomial::operator*(const gf2_polynomial &other) const
+{
+    gf2_polynomial result;
+    result.words = multiply(words, other.words);
+    return result;
+}
+
+gf2_polynomial gf2_polynomial::operator*(int x) const
+{
+    return (x & 1) ? *this : gf2_polynomial();
+}
+
+gf2_polynomial operator*(int x, const gf2_polynomial &p)
+{
+    return p * x;
+}
+
+gf2_polynomial gf2_polynomial::operator%(const gf2_polynomial &divisor) const
+{
+    if (divisor.words.empty())
+    {
+        throw std::runtime_error("error");
+    }
+
+    size_t n = divisor.find_degree_of();
+    size_t m = find_degree_of();
+
+    gf2_polynomial result;
+    if (words.empty() || m < n)
+    {
+        result.words = words;
+        return result;
+    }
+
+    if (m < BARRETT_DEGREE)
+    {
+        result.words = long_remainder(words, divisor.words);
+        return result;
+    }
+
+    // Barrett: q = rev(rev(a) * rev(d)^-1 mod x^k), with k the quotient length
+    size_t k = m - n + 1;
+    words_t inv = inverse_series(reverse(divisor.words, n + 1), k);
+    words_t q_rev = reverse(words, m + 1);
+    truncate(q_rev, k);
+    q_rev = multiply(q_rev, inv);
+    truncate(q_rev, k);
+    words_t q = reverse(q_rev, k);
+
+    result.words = multiply(q, divisor.words);
+    result.words.resize(std::max(result.words.size(), words.size()), 0);
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        result.words[i] ^= words[i];
+    }
+    truncate(result.words, n);
+    return result;
+}
+
+size_t gf2_polynomial::find_degree_of() const
+{
+    return degree_of(words);
+}
+
+std::vector<std::pair<power, coeff>> gf2_polynomial::canonical_form() const
+{
+    std::vector<std::pair<power, coeff>> out;
+
+    for (size_t i = words.size(); i-- > 0;)
+    {
+        for (uint64_t w = words[i]; w != 0;)
+        {
+            int bit = 63 - __builtin_clzll(w);
+            out.push_back({64 * i + bit, 1});
+            w &= ~(1ULL << bit);
+        }
+    }
+
+    if (out.empty())
+    {
+        return {{0, 0}};
+    }
+
+    return out;
+}
@@ -0,0 +1,107 @@
+#ifndef POLY_GF2_H
+#define POLY_GF2_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#include "poly.h"
+
+/**
+ * @brief A polynomial with coefficients in GF(2), stored as packed 64-bit
+ *        words (bit i of the whole array is the coefficient of x^i).
+ *
+ * Has the same operator surface as polynomial. Coefficients given as ints are
+ * reduced mod 2. Addition is XOR, multiplication is carry-less (PCLMULQDQ or
+ * VPCLMULQDQ when the CPU has them) with Karatsuba above a cutoff, and
+ * remainders use Barrett reduction with a Newton-iterated inverse.
+ */
+class gf2_polynomial
+{
+private:
+    std::vector<uint64_t> words; // no trailing zero words; empty for 0
+public:
+    /**
+     * @brief Construct a new gf2_polynomial object that is the number 0
+     *
+     */
+    gf2_polynomial();
+
+    /**
+     * @brief Construct a new gf2_polynomial object from an iterator to pairs of
+     *        <power,coeff>. Each coeff is reduced mod 2, and repeated powers add.
+     *
+     * @tparam Iter
+     *  An iterator that points to a std::pair<power, coeff>
+     * @param begin
+     *  The start of the container to copy elements from
+     * @param end
+     *  The end of the container to copy elements from
+     */
+    template <typename Iter>
+    gf2_polynomial(Iter begin, Iter end);
+
+    /**
+     * @brief Construct a new gf2_polynomial object from an existing one
+     *
+     * @param other
+     *  The polynomial to copy
+     */
+    gf2_polynomial(const gf2_polynomial &other);
+
+    /**
+     * @brief Prints the polynomial.
+     *
+     */
+    void print() const;
+
+    /**
+     * @brief Turn the current instance into a deep copy of another
+     *
+     * @param other
+     * The polynomial to copy
+     * @return
+     * A reference to the copied polynomial
+     */
+    gf2_polynomial &operator=(const gf2_polynomial &other);
+
+    /**
+     * @brief Returns a 128-bit content hash of the polynomial.
+     */
+    content_hash hash() const;
+
+    bool operator==(const gf2_polynomial &other) const;
+    bool operator!=(const gf2_polynomial &other) const;
+
+    /**
+     * Same operators as polynomial. An int operand counts as its parity.
+     * % throws std::runtime_error when dividing by 0.
+     */
+    gf2_polynomial operator+(const gf2_polynomial &other) const;
+    gf2_polynomial operator+(int x) const;
+    friend gf2_polynomial operator+(int x, const gf2_polynomial &p);
+    gf2_polynomial operator*(const gf2_polynomial &other) const;
+    gf2_polynomial operator*(int x) const;
+    friend gf2_polynomial operator*(int x, const gf2_polynomial &p);
+    gf2_polynomial operator%(const gf2_polynomial &divisor) const;
+
+    /**
+     * @brief Returns the degree of the polynomial (0 for the polynomial 0)
+     *
+     * @return size_t
+     *  The degree of the polynomial
+     */
+    size_t find_degree_of() const;
+
+    /**
+     * @brief Returns the canonical form, exactly as polynomial::canonical_form()
+     *        does: descending powers, every coeff 1, and [(0,0)] for 0.
+     *
+     * @return std::vector<std::pair<power, coeff>>
+     *  A vector of pairs representing the canonical form of the polynomial
+     */
+    std::vector<std::pair<power, coeff>> canonical_form() const;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "poly_incremental.h"
+
+maintained_product::maintained_product(const polynomial &a, const polynomial &b)
+    : left(a),
+      right(b),
+      result(a.multiply(b, cache_policy::bypass)),
+      pending(0),
+      batch_limit(64)
+{
+}
+
+static polynomial monomial(power k, coeff c)
+{
+    std::vector<std::pair<power, coeff>> term = {{k, c}};
+    return polynomial(term.begin(), term.end());
+}
+
+void maintained_product::update_a(power k, coeff delta)
+{
+    pending_left += monomial(k, delta);
+    queued(1);
+}
+
+void maintained_product::update_b(power k, coeff delta)
+{
+    pending_right += monomial(k, delta);
+    queued(1);
+}
+
+void maintained_product::update_a(const polynomial &delta)
+{
+    pending_left += delta;
+    queued(delta.term_count());
+}
+
+void maintained_product::update_b(const polynomial &delta)
+{
+    pending_right += delta;
+    queued(delta.term_count());
+}
+
+void maintained_product::queued(size_t terms)
+{
+    pending += terms;
+    if (pending > batch_limit)
+    {
+        flush();
+    }
+}
+
+void maintained_product::set_batch_limit(size_t terms)
+{
+    batch_limit = terms;
+    if (pending > batch_limit)
+    {
+        flush();
+    }
+}
+
+void maintained_product::flush()
+{
+    if (pending == 0)
+    {
+        return;
+    }
+
+    // (a + da)(b + db) - ab = da (b + db) + a db; deltas are one-off
+    // operands, so they stay out of the result cache
+    polynomial zero;
+    right += pending_right;
+    if (pending_left != zero)
+    {
+        result += pending_left.multiply(right, cache_policy::bypass);
+    }
+    if (pending_right != zero)
+    {
+        result += left.multiply(pending_right, cache_policy::bypass);
+    }
+    left += pending_left;
+
+    pending_left = zero;
+    pending_right = zero;
+    pending = 0;
+}
+
+const polynomial &maintained_product::a()
+{
+    flush();
+    return left;
+}
+
+const polynomial &maintained_product::b()
+{
+    flush();
+    return right;
+}
+
+const polynomial &maintained_product::product()
+{
+    flush();
+    return result;
+}
@@ -0,0 +1,71 @@
+#ifndef POLY_INCREMENTAL_H
+#define POLY_INCREMENTAL_H
+
+#include <cstddef>
+
+#include "poly.h"
+
+/**
+ * @brief Keeps c = a * b up to date while terms of a and b change.
+ *
+ * Updates are term-level deltas. They are batched, and a batch is applied as
+ *  c += da * (b + db) + a * db,
+ * which costs O(|da| |b| + |a| |db|) instead of a whole new a * b. The delta
+ * products go through the usual engines (a single-term delta hits the
+ * monomial kernel, a long one the threaded ones), and are added into c in
+ * place. Reading any of the three polynomials applies pending updates first.
+ *
+ * Not thread-safe; callers sharing one object need their own lock.
+ */
+class maintained_product
+{
+public:
+    /**
+     * @brief Starts from c = a * b.
+     */
+    maintained_product(const polynomial &a, const polynomial &b);
+
+    /**
+     * @brief Adds delta x^k to a (or to b). Negative deltas remove terms.
+     */
+    void update_a(power k, coeff delta);
+    void update_b(power k, coeff delta);
+
+    /**
+     * @brief Adds a whole polynomial to a (or to b).
+     */
+    void update_a(const polynomial &delta);
+    void update_b(const polynomial &delta);
+
+    /**
+     * @brief Applies every pending update now.
+     */
+    void flush();
+
+    /**
+     * @brief Sets how many pending delta terms (a and b together) trigger an
+     *        automatic flush. Defaults to 64; 0 flushes on every update.
+     */
+    void set_batch_limit(size_t terms);
+
+    /**
+     * @brief The current operands and product, with pending updates applied
+     */
+    const polynomial &a();
+    const polynomial &b();
+    const polynomial &product();
+
+private:
+    polynomial left;
+    polynomial right;
+    polynomial result;
+
+    polynomial pending_left;
+    polynomial pending_right;
+    size_t pending;
+    size_t batch_limit;
+
+    void queued(size_t terms);
+};
+
+#endif
@@ -0,0 +1,568 @@
+#include "poly_ntt.h"
+#include "poly_thread.h"
+#include <stdexcept>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// NTT primes p = c * 2^k + 1 with 15 * 2^23 dividing p - 1, so lengths
+// 2^k, 3 * 2^k and 5 * 2^k all have roots of unity, each with its primitive
+// root. Their product is about 2^89, enough for any coefficient of an exact
+// product of length NTT_MAX_LENGTH with 32-bit inputs.
+static const uint32_t P1 = 2013265921, G1 = 31; // 15 * 2^27 + 1
+static const uint32_t P2 = 880803841, G2 = 26;  // 105 * 2^23 + 1
+static const uint32_t P3 = 754974721, G3 = 11;  // 45 * 2^24 + 1
+
+template <uint32_t P>
+static uint32_t mul_mod(uint32_t a, uint32_t b)
+{
+    return static_cast<uint32_t>(static_cast<uint64_t>(a) * b % P);
+}
+
+template <uint32_t P>
+static uint32_t pow_mod(uint32_t a, uint64_t e)
+{
+    uint32_t r = 1;
+    for (; e != 0; e >>= 1)
+    {
+        if (e & 1)
+        {
+            r = mul_mod<P>(r, a);
+        }
+        a = mul_mod<P>(a, a);
+    }
+    return r;
+}
+
+// a coeff bit pattern, read as signed, reduced into [0, P)
+template <uint32_t P>
+static uint32_t to_residue(uint32_t x)
+{
+    int64_t v = static_cast<int32_t>(x) % static_cast<int64_t>(P);
+    return static_cast<uint32_t>(v < 0 ? v + P : v);
+}
+
+// the twiddles of every level of a radix-2 transform of length n, level
+// after level: w_len^j for len = 2, 4, .., n and j < len / 2, with w_len a
+// primitive len-th root; n - 1 in all. The table for a length is a prefix
+// of the table for any longer one.
+template <uint32_t P, uint32_t G>
+static std::vector<uint32_t> radix2_twiddles(size_t n)
+{
+    std::vector<uint32_t> twiddles(n == 0 ? 0 : n - 1);
+
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        uint32_t w = pow_mod<P>(G, (P - 1) / len);
+
+        size_t half = len / 2;
+        uint32_t *level = twiddles.data() + (half - 1);
+        level[0] = 1;
+        for (size_t j = 1; j < half; j++)
+        {
+            level[j] = mul_mod<P>(level[j - 1], w);
+        }
+    }
+    return twiddles;
+}
+
+// The plan cache: each prime keeps the twiddle table of the longest transform
+// it has needed, which serves every shorter length too. Readers take a
+// snapshot without locking; a longer table is built under the lock and
+// swapped in, and snapshots already handed out stay valid.
+template <uint32_t P, uint32_t G>
+static std::shared_ptr<const std::vector<uint32_t>> twiddle_plan(size_t n)
+{
+    static std::shared_ptr<const std::vector<uint32_t>> plan;
+    static std::mutex lock;
+
+    auto current = std::atomic_load(&plan);
+    if (current && current->size() + 1 >= n)
+    {
+        return current;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    current = std::atomic_load(&plan);
+    if (current && current->size() + 1 >= n)
+    {
+        return current;
+    }
+
+    current = std::make_shared<const std::vector<uint32_t>>(radix2_twiddles<P, G>(n));
+    std::atomic_store(&plan, current);
+    return current;
+}
+
+// in-place iterative radix-2 transform of a[0, n); n must be a power of two
+// dividing P - 1, and twiddles come from a plan at least n long. The inverse
+// runs the forward butterflies and reverses a[1, n), since w^-j = w^(n - j).
+template <uint32_t P>
+static void radix2_transform(uint32_t *a, size_t n, bool inverse, const uint32_t *twiddles)
+{
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j)
+        {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        size_t half = len / 2;
+        const uint32_t *level = twiddles + (half - 1);
+
+        for (size_t i = 0; i < n; i += len)
+        {
+            for (size_t j = 0; j < half; j++)
+            {
+                uint32_t u = a[i + j];
+                uint32_t v = mul_mod<P>(a[i + j + half], level[j]);
+                a[i + j] = u + v >= P ? u + v - P : u + v;
+                a[i + j + half] = u >= v ? u - v : u + P - v;
+            }
+        }
+    }
+
+    if (inverse)
+    {
+        std::reverse(a + 1, a + n);
+
+        uint32_t n_inv = pow_mod<P>(static_cast<uint32_t>(n % P), P - 2);
+        for (size_t i = 0; i < n; i++)
+        {
+            a[i] = mul_mod<P>(a[i], n_inv);
+        }
+    }
+}
+
+// transforms from this length on take the six-step path
+static std::atomic<size_t> six_step_cutoff(size_t(1) << 20);
+
+// dst[c * rows + r] = src[r * cols + c], a tile at a time so both sides stay in cache
+static void transpose(const uint32_t *src, uint32_t *dst, size_t rows, size_t cols, int threads)
+{
+    const size_t TILE = 32;
+
+    parallel_for((rows + TILE - 1) / TILE, threads, [&](size_t tile)
+    {
+        size_t r_end = std::min(rows, (tile + 1) * TILE);
+        for (size_t c0 = 0; c0 < cols; c0 += TILE)
+        {
+            size_t c_end = std::min(cols, c0 + TILE);
+            for (size_t r = tile * TILE; r < r_end; r++)
+            {
+                for (size_t c = c0; c < c_end; c++)
+                {
+                    dst[c * rows + r] = src[r * cols + c];
+                }
+            }
+        }
+    });
+}
+
+// row j of a rows x cols matrix times w^(j k) at column k
+template <uint32_t P>
+static void twiddle_row(uint32_t *row, size_t cols, uint32_t w)
+{
+    uint32_t x = 1;
+    for (size_t k = 0; k < cols; k++)
+    {
+        row[k] = mul_mod<P>(row[k], x);
+        x = mul_mod<P>(x, w);
+    }
+}
+
+// Six-step transform of n = n1 n2 points, with index j1 + n1 j2 in and
+// k2 + n2 k1 out: n1 transforms of length n2 over the strided columns,
+// twiddles omega^(j1 k2), then n2 transforms of length n1. Transposes make
+// every short transform contiguous and small enough for cache, and each pass
+// is split across threads. The forward output is left in [k2][k1] order
+// (skipping the last transpose) and the inverse expects it, which is all a
+// convolution needs.
+template <uint32_t P, uint32_t G>
+static void six_step_transform(dense_coeffs &a, bool inverse, int threads)
+{
+    size_t n = a.size();
+    size_t bits = 0;
+    while ((size_t(1) << bits) < n)
+    {
+        bits++;
+    }
+    size_t n1 = size_t(1) << (bits / 2);
+    size_t n2 = n / n1;
+
+    uint32_t omega = pow_mod<P>(G, (P - 1) / n);
+    if (inverse)
+    {
+        omega = pow_mod<P>(omega, P - 2);
+    }
+
+    dense_coeffs t(n);
+    auto twiddles = twiddle_plan<P, G>(n2); // n2 >= n1
+
+    if (!inverse)
+    {
+        transpose(a.data(), t.data(), n2, n1, threads); // t[j1][j2]
+        parallel_for(n1, threads, [&](size_t j1)
+        {
+            radix2_transform<P>(t.data() + j1 * n2, n2, false, twiddles->data());
+            twiddle_row<P>(t.data() + j1 * n2, n2, pow_mod<P>(omega, j1));
+        });
+        transpose(t.data(), a.data(), n1, n2, threads); // a[k2][j1]
+        parallel_for(n2, threads, [&](size_t k2)
+        {
+            radix2_transform<P>(a.data() + k2 * n1, n1, false, twiddles->data());
+        });
+    }
+    else
+    {
+        parallel_for(n2, threads, [&](size_t k2)
+        {
+            radix2_transform<P>(a.data() + k2 * n1, n1, true, twiddles->data());
+        });
+        transpose(a.data(), t.data(), n2, n1, threads); // t[j1][k2]
+        parallel_for(n1, threads, [&](size_t j1)
+        {
+            twiddle_row<P>(t.data() + j1 * n2, n2, pow_mod<P>(omega, j1));
+            radix2_transform<P>(t.data() + j1 * n2, n2, true, twiddles->data());
+        });
+        transpose(t.data(), a.data(), n1, n2, threads); // a[j2][j1]
+    }
+}
+
+// a forward transform's output order is only meaningful to the inverse
+template <uint32_t P, uint32_t G>
+static void transform(dense_coeffs &a, bool inverse, int threads)
+{
+    if (a.size() >= std::max<size_t>(4, six_step_cutoff.load(std::memory_order_relaxed)))
+    {
+        six_step_transform<P, G>(a, inverse, threads);
+    }
+    else
+    {
+        radix2_transform<P>(a.data(), a.size(), inverse, twiddle_plan<P, G>(a.size())->data());
+    }
+}
+
+// fa * fb mod y^m - theta^m in place, by substituting y -> theta y, which
+// turns it into a cyclic product of power-of-two length m
+template <uint32_t P, uint32_t G>
+static void twisted_product(dense_coeffs &fa, dense_coeffs &fb, uint32_t theta, int threads)
+{
+    size_t m = fa.size();
+
+    if (theta != 1)
+    {
+        for (size_t i = 0, w = 1; i < m; i++, w = mul_mod<P>(static_cast<uint32_t>(w), theta))
+        {
+            fa[i] = mul_mod<P>(fa[i], static_cast<uint32_t>(w));
+            fb[i] = mul_mod<P>(fb[i], static_cast<uint32_t>(w));
+        }
+    }
+
+    transform<P, G>(fa, false, threads);
+    transform<P, G>(fb, false, threads);
+    for (size_t i = 0; i < m; i++)
+    {
+        fa[i] = mul_mod<P>(fa[i], fb[i]);
+    }
+    transform<P, G>(fa, true, threads);
+
+    if (theta != 1)
+    {
+        uint32_t theta_inv = pow_mod<P>(theta, P - 2);
+        for (size_t i = 0, w = 1; i < m; i++, w = mul_mod<P>(static_cast<uint32_t>(w), theta_inv))
+        {
+            fa[i] = mul_mod<P>(fa[i], static_cast<uint32_t>(w));
+        }
+    }
+}
+
+// the odd factor of a supported transform length
+static size_t odd_part(size_t n)
+{
+    return n % 3 == 0 ? 3 : (n % 5 == 0 ? 5 : 1);
+}
+
+// one prime's share of a product: a * b mod x^n - 1, or mod x^n + 1 when
+// negacyclic; inputs are zero-padded to n.
+//
+// For n = r m with m a power of two, x^n - psi^n (psi = 1, or a 2n-th root
+// of unity when negacyclic) splits into the r factors x^m - theta_j^m with
+// theta_j = psi omega^j, omega a primitive n-th root. Reducing into each
+// factor is an r-point DFT over the blocks of m coefficients, each factor is
+// a twisted length-m product, and the inverse DFT puts the blocks back, so
+// the transforms are m long rather than the next power of two above n.
+template <uint32_t P, uint32_t G>
+static dense_coeffs convolve(const dense_coeffs &a, const dense_coeffs &b, size_t n, bool negacyclic, int threads)
+{
+    size_t r = odd_part(n);
+    size_t m = n / r;
+
+    uint32_t psi = negacyclic ? pow_mod<P>(G, (P - 1) / (2 * n)) : 1;
+    uint32_t omega = pow_mod<P>(G, (P - 1) / n);
+    uint32_t zeta = pow_mod<P>(omega, m); // a primitive r-th root of unity
+    uint32_t psi_m = pow_mod<P>(psi, m);
+
+    std::vector<dense_coeffs> parts(r);
+    for (size_t j = 0; j < r; j++)
+    {
+        // block t of the input counts theta_j^(m t) = (psi^m zeta^j)^t times
+        uint32_t step = mul_mod<P>(psi_m, pow_mod<P>(zeta, j));
+        dense_coeffs fa(m, 0), fb(m, 0);
+
+        for (size_t t = 0, w = 1; t < r; t++, w = mul_mod<P>(static_cast<uint32_t>(w), step))
+        {
+            for (size_t i = t * m; i < std::min(a.size(), (t + 1) * m); i++)
+            {
+                uint32_t x = to_residue<P>(a[i]);
+                x = w == 1 ? x : mul_mod<P>(x, static_cast<uint32_t>(w));
+                fa[i - t * m] = fa[i - t * m] + x >= P ? fa[i - t * m] + x - P : fa[i - t * m] + x;
+            }
+            for (size_t i = t * m; i < std::min(b.size(), (t + 1) * m); i++)
+            {
+                uint32_t x = to_residue<P>(b[i]);
+                x = w == 1 ? x : mul_mod<P>(x, static_cast<uint32_t>(w));
+                fb[i - t * m] = fb[i - t * m] + x >= P ? fb[i - t * m] + x - P : fb[i - t * m] + x;
+            }
+        }
+
+        twisted_product<P, G>(fa, fb, mul_mod<P>(psi, pow_mod<P>(omega, j)), threads);
+        parts[j] = std::move(fa);
+    }
+
+    if (r == 1)
+    {
+        return std::move(parts[0]);
+    }
+
+    // block t = r^-1 psi^(-m t) sum over j of zeta^(-j t) parts[j]
+    dense_coeffs out(n, 0);
+    uint32_t r_inv = pow_mod<P>(static_cast<uint32_t>(r), P - 2);
+    uint32_t zeta_inv = pow_mod<P>(zeta, P - 2);
+    uint32_t psi_m_inv = pow_mod<P>(psi_m, P - 2);
+
+    for (size_t t = 0; t < r; t++)
+    {
+        uint32_t scale = mul_mod<P>(r_inv, pow_mod<P>(psi_m_inv, t));
+        for (size_t j = 0; j < r; j++)
+        {
+            uint32_t w = mul_mod<P>(scale, pow_mod<P>(zeta_inv, j * t));
+            uint32_t *block = out.data() + t * m;
+            for (size_t i = 0; i < m; i++)
+            {
+                uint32_t x = mul_mod<P>(parts[j][i], w);
+                block[i] = block[i] + x >= P ? block[i] + x - P : block[i] + x;
+            }
+        }
+    }
+
+    return out;
+}
+
+// Garner's CRT, then the signed result reduced mod 2^32
+static dense_coeffs recombine(const dense_coeffs &r1, const dense_coeffs &r2, const dense_coeffs &r3, size_t length, int threads)
+{
+    const uint32_t p1_inv_p2 = pow_mod<P2>(P1 % P2, P2 - 2);
+    const uint32_t p1p2_inv_p3 = pow_mod<P3>(mul_mod<P3>(P1 % P3, P2 % P3), P3 - 2);
+    const unsigned __int128 p1p2 = static_cast<unsigned __int128>(P1) * P2;
+    const unsigned __int128 m = p1p2 * P3;
+    const unsigned __int128 half = m / 2;
+
+    dense_coeffs out(length);
+    const size_t BLOCK = 1 << 14;
+
+    parallel_for((length + BLOCK - 1) / BLOCK, threads, [&](size_t block)
+    {
+        size_t end = std::min(length, (block + 1) * BLOCK);
+        for (size_t i = block * BLOCK; i < end; i++)
+        {
+            uint32_t t2 = mul_mod<P2>((r2[i] + P2 - r1[i] % P2) % P2, p1_inv_p2);
+            uint32_t partial = static_cast<uint32_t>((r1[i] + static_cast<uint64_t>(P1) * t2) % P3);
+            uint32_t t3 = mul_mod<P3>((r3[i] + P3 - partial) % P3, p1p2_inv_p3);
+
+            unsigned __int128 x = r1[i] + static_cast<unsigned __int128>(P1) * t2 + p1p2 * t3;
+            uint32_t low = static_cast<uint32_t>(x);
+            out[i] = x > half ? low - static_cast<uint32_t>(m) : low;
+        }
+    });
+
+    return out;
+}
+
+static dense_coeffs multiply_three_primes(const dense_coeffs &a, const dense_coeffs &b, size_t n, size_t length, bool negacyclic, int threads)
+{
+    dense_coeffs r1, r2, r3;
+
+    auto run = [&](size_t prime, int inner)
+    {
+        switch (prime)
+        {
+        case 0:
+            r1 = convolve<P1, G1>(a, b, n, negacyclic, inner);
+            break;
+        case 1:
+            r2 = convolve<P2, G2>(a, b, n, negacyclic, inner);
+            break;
+        default:
+            r3 = convolve<P3, G3>(a, b, n, negacyclic, inner);
+            break;
+        }
+    };
+
+    // six-step transforms spread every pass over all the threads, so the
+    // primes take turns; shorter transforms get one thread per prime
+    if (threads > 3 && n / odd_part(n) >= six_step_cutoff.load(std::memory_order_relaxed))
+    {
+        for (size_t prime = 0; prime < 3; prime++)
+        {
+            run(prime, threads);
+        }
+    }
+    else
+    {
+        parallel_for(3, threads, [&](size_t prime)
+        {
+            run(prime, 1);
+        });
+    }
+
+    return recombine(r1, r2, r3, length, threads);
+}
+
+void set_ntt_six_step_cutoff(size_t length)
+{
+    six_step_cutoff.store(length, std::memory_order_relaxed);
+}
+
+size_t ntt_six_step_cutoff()
+{
+    return six_step_cutoff.load(std::memory_order_relaxed);
+}
+
+void ntt_warm_up(size_t max_length)
+{
+    // The power-of-two part of any length ntt_length() picks for a product
+    // of up to max_length coefficients is at most the next power of two, and
+    // a table serves every shorter length too.
+    size_t n = 1;
+    while (n < std::min(max_length, NTT_MAX_LENGTH))
+    {
+        n <<= 1;
+    }
+
+    parallel_for(3, 3, [&](size_t prime)
+    {
+        switch (prime)
+        {
+        case 0:
+            twiddle_plan<P1, G1>(n);
+            break;
+        case 1:
+            twiddle_plan<P2, G2>(n);
+            break;
+        default:
+            twiddle_plan<P3, G3>(n);
+            break;
+        }
+    });
+}
+
+size_t ntt_warm_length()
+{
+    // asking for length 0 never builds anything beyond an empty table
+    return std::min({twiddle_plan<P1, G1>(0)->size(), twiddle_plan<P2, G2>(0)->size(), twiddle_plan<P3, G3>(0)->size()}) + 1;
+}
+
+size_t ntt_length(size_t length)
+{
+    // r 2^k costs about k butterfly passes plus r passes to split into and
+    // rebuild from its r blocks
+    size_t best = 0;
+    double best_cost = 0;
+
+    for (size_t r : {1, 3, 5})
+    {
+        size_t n = r, passes = 0;
+        while (n < length && n <= NTT_MAX_LENGTH)
+        {
+            n <<= 1;
+            passes++;
+        }
+
+        double cost = static_cast<double>(n) * (passes + (r == 1 ? 0 : r));
+        if (n <= NTT_MAX_LENGTH && (best == 0 || cost < best_cost))
+        {
+            best = n;
+            best_cost = cost;
+        }
+    }
+
+    return best;
+}
+
+dense_coeffs ntt_multiply(const dense_coeffs &a, const dense_coeffs &b, int threads)
+{
+    if (a.empty() || b.empty())
+    {
+        return {};
+    }
+
+    size_t length = a.size() + b.size() - 1;
+    size_t n = ntt_length(length);
+    if (n == 0)
+    {
+        throw std::runtime_error("error");
+    }
+
+    return multiply_three_primes(a, b, n, length, false, threads);
+}
+
+dense_coeffs ntt_middle_product(const dense_coeffs &a, const dense_coeffs &b, int threads)
+{
+    if (b.empty() || a.size() < b.size())
+    {
+        return {};
+    }
+
+    size_t n = b.size();
+    size_t m = a.size() - n + 1;
+    size_t length = ntt_length(a.size());
+    if (length == 0)
+    {
+        throw std::runtime_error("error");
+    }
+
+    // the full product reaches m + 2n - 3 < length + n - 1, so wrapped
+    // coefficients fall below n - 1
+    dense_coeffs c = multiply_three_primes(a, b, length, length, false, threads);
+    return dense_coeffs(c.begin() + (n - 1), c.begin() + (n - 1 + m));
+}
+
+bool ntt_cyclic_supported(size_t n, bool negacyclic)
+{
+    size_t m = n == 0 ? 0 : n / odd_part(n);
+    bool power_of_two = m != 0 && (m & (m - 1)) == 0;
+    return power_of_two && (negacyclic ? 2 * n : n) <= NTT_MAX_LENGTH;
+}
+
+dense_coeffs ntt_multiply_cyclic(const dense_coeffs &a, const dense_coeffs &b, bool negacyclic, int threads)
+{
+    size_t n = a.size();
+    if (b.size() != n || !ntt_cyclic_supported(n, negacyclic))
+    {
+        throw std::runtime_error("error");
+    }
+
+    return multiply_three_primes(a, b, n, n, negacyclic, threads);
+}
@@ -0,0 +1,102 @@
+#ifndef POLY_NTT_H
+#define POLY_NTT_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "poly_dense.h"
+
+/**
+ * @brief The longest transform the three NTT primes support. A linear
+ *        product can have at most this many coefficients.
+ */
+const size_t NTT_MAX_LENGTH = size_t(1) << 23;
+
+/**
+ * @brief Returns the transform length ntt_multiply() uses for a product with
+ *        `length` coefficients, or 0 if the product is too long. This is the
+ *        cheapest of 2^k, 3 * 2^k and 5 * 2^k at or above length, so a
+ *        product isn't padded to nearly twice its size.
+ */
+size_t ntt_length(size_t length);
+
+/**
+ * @brief Sets the transform length from which NTTs use the six-step
+ *        decomposition: short row transforms that fit in cache, a twiddle pass
+ *        and tiled transposes, each spread across threads. Below it a plain
+ *        radix-2 transform is used. Defaults to 2^20; SIZE_MAX turns the
+ *        six-step path off.
+ */
+void set_ntt_six_step_cutoff(size_t length);
+size_t ntt_six_step_cutoff();
+
+/**
+ * @brief Builds the transform tables for every product of up to max_length
+ *        coefficients now, instead of on the first product that needs them.
+ *        Tables are otherwise built lazily, once per prime, and shared by all
+ *        later transforms and threads.
+ */
+void ntt_warm_up(size_t max_length);
+
+/**
+ * @brief Returns the longest power-of-two transform all three primes have
+ *        tables for (1 before any are built).
+ */
+size_t ntt_warm_length();
+
+/**
+ * @brief Computes the linear product a * b with number-theoretic transforms.
+ *
+ * The convolution is done modulo three primes, one thread per prime (or all
+ * threads per prime in turn, for six-step lengths), and recombined with the
+ * CRT. The primes are large enough to recover every coefficient of the exact
+ * integer product. Reducing that mod 2^32 matches the wrapping schoolbook
+ * product bit for bit.
+ *
+ * @param threads
+ *  The maximum number of threads to use
+ * @return dense_coeffs
+ *  a.size() + b.size() - 1 coefficients
+ */
+dense_coeffs ntt_multiply(const dense_coeffs &a, const dense_coeffs &b, int threads);
+
+/**
+ * @brief Computes the middle product of a and b (see dense_middle_product())
+ *        with cyclic transforms of length ntt_length(a.size()): the terms that
+ *        wrap around only reach coefficients below b.size() - 1, which the
+ *        middle product drops. Throws std::runtime_error if a is too long.
+ *
+ * @param threads
+ *  The maximum number of threads to use
+ * @return dense_coeffs
+ *  a.size() - b.size() + 1 coefficients
+ */
+dense_coeffs ntt_middle_product(const dense_coeffs &a, const dense_coeffs &b, int threads);
+
+/**
+ * @brief Returns whether ntt_multiply_cyclic() supports a ring of size n:
+ *        n must be 2^k, 3 * 2^k or 5 * 2^k and fit NTT_MAX_LENGTH (twice
+ *        over when negacyclic).
+ */
+bool ntt_cyclic_supported(size_t n, bool negacyclic);
+
+/**
+ * @brief Computes a * b mod x^n - 1 (cyclic) or mod x^n + 1 (negacyclic),
+ *        with transforms of length n. The negacyclic case twists the inputs
+ *        by a 2n-th root of unity, so the double-length product is never built.
+ *        Lengths 3 * 2^k and 5 * 2^k are split into 3 or 5 power-of-two
+ *        transforms.
+ *
+ * @param a
+ *  n coefficients, already reduced into the ring
+ * @param b
+ *  n coefficients, already reduced into the ring
+ * @param threads
+ *  The maximum number of threads to use
+ * @return dense_coeffs
+ *  n coefficients
+ */
+dense_coeffs ntt_multiply_cyclic(const dense_coeffs &a, const dense_coeffs &b, bool negacyclic, int threads);
+
+#endif
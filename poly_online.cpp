@@ -0,0 +1,67 @@
+#include "poly_online.h"
+
+online_product::online_product()
+{
+}
+
+// result[(u + v) s ..] += a[u s, (u + 1) s) * b[v s, (v + 1) s)
+void online_product::add_square(size_t s, size_t u, size_t v)
+{
+    dense_coeffs a(left.begin() + u * s, left.begin() + (u + 1) * s);
+    dense_coeffs b(right.begin() + v * s, right.begin() + (v + 1) * s);
+    dense_coeffs c = dense_multiply(a, b, polynomial::max_threads());
+
+    for (size_t i = 0; i < c.size(); i++)
+    {
+        result[(u + v) * s + i] += c[i];
+    }
+}
+
+coeff online_product::push(coeff a_k, coeff b_k)
+{
+    size_t k = left.size();
+    left.push_back(static_cast<uint32_t>(a_k));
+    right.push_back(static_cast<uint32_t>(b_k));
+    result.resize(2 * k + 2, 0);
+
+    if (k == 0)
+    {
+        result[0] += left[0] * right[0];
+    }
+    else
+    {
+        result[k] += left[k] * right[0] + left[0] * right[k];
+    }
+
+    // every square whose last row or column just arrived; each lands on
+    // x^(k + 1) and above, so result[k] is already final
+    for (size_t s = 1; (k + 1) % s == 0 && (k + 1) / s >= 2; s <<= 1)
+    {
+        size_t w = (k + 1) / s - 1;
+        add_square(s, 1, w);
+        if (w != 1)
+        {
+            add_square(s, w, 1);
+        }
+    }
+
+    return static_cast<coeff>(result[k]);
+}
+
+size_t online_product::size() const
+{
+    return left.size();
+}
+
+polynomial online_product::prefix() const
+{
+    std::vector<std::pair<power, coeff>> out;
+    for (size_t i = 0; i < left.size(); i++)
+    {
+        if (result[i] != 0)
+        {
+            out.push_back({i, static_cast<coeff>(result[i])});
+        }
+    }
+    return polynomial(out.begin(), out.end());
+}
@@ -0,0 +1,61 @@
+#ifndef POLY_ONLINE_H
+#define POLY_ONLINE_H
+
+#include <cstddef>
+
+#include "poly.h"
+#include "poly_dense.h"
+
+/**
+ * @brief Relaxed (online) multiplication: the coefficients of a and b arrive
+ *        one at a time, lowest power first, and coefficient k of a * b is
+ *        returned as soon as a_0..a_k and b_0..b_k are known.
+ *
+ * Products involving a_0 or b_0 are added naively as their partner arrives.
+ * The rest of the i, j >= 1 quadrant is tiled by dyadic squares: for each
+ * s = 2^m, the blocks [s, 2s) x [W s, (W + 1) s) and their mirror images for
+ * W >= 1. Each square is multiplied with the dense kernels (Karatsuba or
+ * NTT) the step its last input arrives, and only feeds coefficients past that
+ * step, so every output is complete in time. Pushing n coefficients costs
+ * O(M(n) log n) in total instead of the O(n^2) of recomputing each prefix.
+ */
+class online_product
+{
+public:
+    /**
+     * @brief Starts with no coefficients of either operand.
+     */
+    online_product();
+
+    /**
+     * @brief Feeds the next coefficient of each operand.
+     *
+     * @param a_k
+     *  The coefficient of x^k in a, where k is size() before the call
+     * @param b_k
+     *  The coefficient of x^k in b
+     * @return coeff
+     *  The coefficient of x^k in a * b
+     */
+    coeff push(coeff a_k, coeff b_k);
+
+    /**
+     * @brief Returns the number of coefficients pushed so far
+     */
+    size_t size() const;
+
+    /**
+     * @brief Returns the coefficients emitted so far as a polynomial, i.e.
+     *        a * b mod x^size()
+     */
+    polynomial prefix() const;
+
+private:
+    dense_coeffs left;
+    dense_coeffs right;
+    dense_coeffs result; // emitted up to size(), partial sums past it
+
+    void add_square(size_t s, size_t u, size_t v);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "poly_thread.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <vector>
+#include <pthread.h>
+
+struct parallel_work
+{
+    const std::function<void(size_t)> *task;
+    std::atomic<size_t> next;
+    size_t count;
+    std::mutex lock;
+    std::exception_ptr error; // the first task to throw, rethrown by the caller
+};
+
+static thread_local bool inside_task = false;
+
+static void *parallel_worker(void *arg)
+{
+    parallel_work *work = static_cast<parallel_work*>(arg);
+    bool outer = inside_task;
+    inside_task = true;
+
+    for (size_t i = work->next++; i < work->count; i = work->next++)
+    {
+        try
+        {
+            (*work->task)(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> guard(work->lock);
+            if (!work->error)
+            {
+                work->error = std::current_exception();
+            }
+            work->next = work->count; // hand out nothing more
+        }
+    }
+
+    inside_task = outer;
+    return nullptr;
+}
+
+bool in_parallel_task()
+{
+    return inside_task;
+}
+
+void parallel_for(size_t count, int threads, const std::function<void(size_t)> &task)
+{
+    size_t num = inside_task ? 1 : std::min<size_t>(std::max(threads, 1), count);
+
+    if (num <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    parallel_work work;
+    work.task = &task;
+    work.next = 0;
+    work.count = count;
+
+    std::vector<pthread_t> workers(num - 1);
+    std::vector<bool> started(num - 1, false);
+
+    for (size_t t = 0; t + 1 < num; t++)
+    {
+        started[t] = pthread_create(&workers[t], nullptr, parallel_worker, &work) == 0;
+    }
+
+    parallel_worker(&work);
+
+    for (size_t t = 0; t + 1 < num; t++)
+    {
+        if (started[t])
+        {
+            pthread_join(workers[t], nullptr);
+        }
+    }
+
+    if (work.error)
+    {
+        std::rethrow_exception(work.error);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef POLY_THREAD_H
+#define POLY_THREAD_H
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Runs task(0) .. task(count - 1), spread over up to `threads` threads
+ *        (the calling thread is one of them). Tasks are handed out one at a
+ *        time, so uneven tasks still balance. Returns once all have finished.
+ *        If a task throws, no new tasks start and the first exception is
+ *        rethrown on the calling thread once the others have finished.
+ *
+ * Inside a task that is running alongside others, nested calls run serially
+ * so parallel phases don't multiply their thread counts. A caller with only
+ * a few large tasks should pass threads = 1 instead, so each task runs on the
+ * calling thread and keeps the full thread budget for its own nested calls.
+ *
+ * @param count
+ *  The number of tasks
+ * @param threads
+ *  The maximum number of threads to use, including the caller
+ * @param task
+ *  Called once with each task index
+ */
+void parallel_for(size_t count, int threads, const std::function<void(size_t)> &task);
+
+/**
+ * @brief Returns whether the calling thread is running a parallel_for task
+ *        that shares the machine with other tasks.
+ */
+bool in_parallel_task();
+
+#endif
@@ -0,0 +1,268 @@
+#include "poly_tree.h"
+#include "poly_thread.h"
+#include <stdexcept>
+#include <cstdint>
+
+// Threads for one tree level of `nodes` independent operations. A nested
+// parallel_for runs serially, so spreading a narrow level (the top few large
+// nodes) over threads would leave each node a single thread; handing the
+// level one thread instead runs its nodes in turn, each with every thread.
+static int level_threads(size_t nodes)
+{
+    const int threads = polynomial::max_threads();
+    return nodes >= static_cast<size_t>(threads) ? threads : 1;
+}
+
+// product tree
+
+product_tree::product_tree(const std::vector<polynomial> &factors)
+{
+    nodes.push_back(factors);
+    if (factors.empty())
+    {
+        nodes.back().push_back(polynomial() + 1);
+    }
+
+    while (nodes.back().size() > 1)
+    {
+        const std::vector<polynomial> &below = nodes.back();
+        std::vector<polynomial> level((below.size() + 1) / 2);
+
+        parallel_for(below.size() / 2, level_threads(below.size() / 2), [&](size_t i)
+        {
+            level[i] = below[2 * i].multiply(below[2 * i + 1], cache_policy::bypass);
+        });
+
+        if (below.size() % 2 == 1)
+        {
+            level.back() = below.back();
+        }
+
+        nodes.push_back(std::move(level));
+    }
+}
+
+const polynomial &product_tree::root() const
+{
+    return nodes.back().front();
+}
+
+const std::vector<std::vector<polynomial>> &product_tree::levels() const
+{
+    return nodes;
+}
+
+polynomial product(const std::vector<polynomial> &factors)
+{
+    return product_tree(factors).root();
+}
+
+// remainder tree
+
+std::vector<polynomial> remainders(const polynomial &f, const product_tree &moduli)
+{
+    const auto &levels = moduli.levels();
+    const std::vector<polynomial> &leaves = levels.front();
+
+    bool unit_leading = true;
+    for (const auto &m : leaves)
+    {
+        coeff lead = m.canonical_form().front().second;
+        unit_leading = unit_leading && (lead == 1 || lead == -1);
+    }
+
+    if (!unit_leading)
+    {
+        std::vector<polynomial> out(leaves.size());
+        parallel_for(leaves.size(), polynomial::max_threads(), [&](size_t i)
+        {
+            out[i] = f.remainder(leaves[i], cache_policy::bypass);
+        });
+        return out;
+    }
+
+    // node i of a level has children 2i and 2i + 1 on the level below
+    std::vector<polynomial> above = {f.remainder(moduli.root(), cache_policy::bypass)};
+
+    for (size_t k = levels.size() - 1; k-- > 0;)
+    {
+        const std::vector<polynomial> &level = levels[k];
+        std::vector<polynomial> below(level.size());
+
+        parallel_for(level.size(), level_threads(level.size()), [&](size_t i)
+        {
+            below[i] = above[i / 2].remainder(level[i], cache_policy::bypass);
+        });
+
+        above = std::move(below);
+    }
+
+    return above;
+}
+
+// CRT reconstruction
+
+// a polynomial mod 2, one byte per coefficient from x^0 up, with no
+// trailing zeros (so empty is 0)
+using gf2_bits = std::vector<uint8_t>;
+
+static gf2_bits to_bits(const polynomial &p)
+{
+    gf2_bits out;
+    for (const auto &term : p.canonical_form())
+    {
+        if (term.second & 1)
+        {
+            if (out.empty())
+            {
+                out.resize(term.first + 1, 0);
+            }
+            out[term.first] = 1;
+        }
+    }
+    return out;
+}
+
+// a += b * x^shift
+static void add_shifted(gf2_bits &a, const gf2_bits &b, size_t shift)
+{
+    if (a.size() < b.size() + shift)
+    {
+        a.resize(b.size() + shift, 0);
+    }
+    for (size_t i = 0; i < b.size(); i++)
+    {
+        a[i + shift] ^= b[i];
+    }
+    while (!a.empty() && a.back() == 0)
+    {
+        a.pop_back();
+    }
+}
+
+// the inverse of u mod m, both read mod 2; throws unless they are coprime
+static polynomial inverse_mod2(const polynomial &u, const polynomial &m)
+{
+    gf2_bits r0 = to_bits(m), r1 = to_bits(u);
+    gf2_bits t0, t1 = {1};
+
+    while (!r1.empty())
+    {
+        while (r0.size() >= r1.size())
+        {
+            size_t shift = r0.size() - r1.size();
+            add_shifted(r0, r1, shift);
+            add_shifted(t0, t1, shift);
+        }
+        std::swap(r0, r1);
+        std::swap(t0, t1);
+    }
+
+    // a unit modulus leaves every remainder 0, so any inverse will do
+    if (r0.size() != 1 && to_bits(m).size() > 1)
+    {
+        throw std::runtime_error("error");
+    }
+
+    std::vector<std::pair<power, coeff>> terms;
+    for (size_t i = 0; i < t0.size(); i++)
+    {
+        if (t0[i])
+        {
+            terms.push_back({i, 1});
+        }
+    }
+    return polynomial(terms.begin(), terms.end()).remainder(m, cache_policy::bypass);
+}
+
+// the inverse of u mod m over the wrapping integers: s = u^-1 mod 2, then
+// s <- s (2 - u s), which doubles the number of correct low bits each round
+static polynomial inverse_mod(const polynomial &u, const polynomial &m)
+{
+    polynomial s = inverse_mod2(u, m);
+    for (int bits = 1; bits < 32; bits *= 2)
+    {
+        polynomial us = u.multiply(s, cache_policy::bypass).remainder(m, cache_policy::bypass);
+        s = s.multiply(us * -1 + 2, cache_policy::bypass).remainder(m, cache_policy::bypass);
+    }
+    return s;
+}
+
+polynomial chinese_remainder(const std::vector<polynomial> &residues, const product_tree &moduli)
+{
+    const auto &levels = moduli.levels();
+    const std::vector<polynomial> &leaves = levels.front();
+
+    if (residues.size() != leaves.size() && !(residues.empty() && leaves.size() == 1))
+    {
+        throw std::runtime_error("error");
+    }
+    if (residues.empty())
+    {
+        return polynomial();
+    }
+
+    for (const auto &m : leaves)
+    {
+        coeff lead = m.canonical_form().front().second;
+        if (lead != 1 && lead != -1)
+        {
+            throw std::runtime_error("error");
+        }
+    }
+
+    // top-down: node i ends up holding (M / node) mod node, where M is the root
+    std::vector<polynomial> above = {polynomial() + 1};
+
+    for (size_t k = levels.size() - 1; k-- > 0;)
+    {
+        const std::vector<polynomial> &level = levels[k];
+        std::vector<polynomial> below(level.size());
+
+        parallel_for(level.size(), level_threads(level.size()), [&](size_t i)
+        {
+            size_t sibling = i ^ 1;
+            if (sibling >= level.size())
+            {
+                below[i] = above[i / 2]; // carried up, so the same modulus
+                return;
+            }
+            polynomial cofactor = above[i / 2].remainder(level[i], cache_policy::bypass);
+            polynomial other = level[sibling].remainder(level[i], cache_policy::bypass);
+            below[i] = cofactor.multiply(other, cache_policy::bypass).remainder(level[i], cache_policy::bypass);
+        });
+
+        above = std::move(below);
+    }
+
+    // leaves: r_i * (M / m_i)^-1 mod m_i
+    std::vector<polynomial> parts(leaves.size());
+    parallel_for(leaves.size(), polynomial::max_threads(), [&](size_t i)
+    {
+        polynomial s = inverse_mod(above[i], leaves[i]);
+        polynomial r = residues[i].remainder(leaves[i], cache_policy::bypass);
+        parts[i] = r.multiply(s, cache_policy::bypass).remainder(leaves[i], cache_policy::bypass);
+    });
+
+    // bottom-up: f = f_L * P_R + f_R * P_L
+    for (size_t k = 0; k + 1 < levels.size(); k++)
+    {
+        const std::vector<polynomial> &level = levels[k];
+        std::vector<polynomial> merged((parts.size() + 1) / 2);
+
+        parallel_for(parts.size() / 2, level_threads(parts.size() / 2), [&](size_t i)
+        {
+            merged[i] = parts[2 * i].multiply(level[2 * i + 1], cache_policy::bypass) +
+                        parts[2 * i + 1].multiply(level[2 * i], cache_policy::bypass);
+        });
+
+        if (parts.size() % 2 == 1)
+        {
+            merged.back() = parts.back();
+        }
+
+        parts = std::move(merged);
+    }
+
+    return parts.front();
+}
@@ -0,0 +1,101 @@
+#ifndef POLY_TREE_H
+#define POLY_TREE_H
+
+#include <vector>
+#include <cstddef>
+
+#include "poly.h"
+
+/**
+ * @brief A balanced binary tree of partial products of a list of factors.
+ *
+ * Level 0 holds the factors, each node of level k + 1 is the product of two
+ * neighbouring nodes of level k (an odd node out is carried up unchanged),
+ * and the last level holds the product of everything. Every level is built
+ * in parallel. The tree is kept so later passes, such as remainder trees, can
+ * reuse the partial products.
+ */
+class product_tree
+{
+public:
+    /**
+     * @brief Builds the tree.
+     *
+     * @param factors
+     *  The polynomials to multiply; an empty list has product 1
+     */
+    explicit product_tree(const std::vector<polynomial> &factors);
+
+    /**
+     * @brief Returns the product of all the factors
+     */
+    const polynomial &root() const;
+
+    /**
+     * @brief Returns every level, from the factors up to the root
+     */
+    const std::vector<std::vector<polynomial>> &levels() const;
+
+private:
+    std::vector<std::vector<polynomial>> nodes;
+};
+
+/**
+ * @brief Multiplies many polynomials in a balanced product tree, which costs
+ *        O(M(n) log k) instead of the O(k^2)-sized products of a left-to-right
+ *        fold. Equal to factors[0] * factors[1] * ... .
+ *
+ * @param factors
+ *  The polynomials to multiply; an empty list has product 1
+ */
+polynomial product(const std::vector<polynomial> &factors);
+
+/**
+ * @brief Reduces f modulo every factor of a product tree, i.e. returns
+ *        f % moduli.levels()[0][i] for every i.
+ *
+ * f is reduced modulo the root once, and each node's remainder is then
+ * reduced modulo its two children, so only the top division sees the full
+ * size of f. Subtrees are reduced in parallel, and with fast division the
+ * total cost is O(M(n) log k).
+ *
+ * This needs every modulus to have leading coefficient 1 or -1, which is
+ * what makes (f mod m1 m2) mod m1 equal f mod m1 with the truncating integer
+ * division of operator%. If any modulus doesn't, each remainder is computed
+ * directly (still in parallel). Throws std::runtime_error if a modulus is 0.
+ *
+ * @param f
+ *  The polynomial to reduce
+ * @param moduli
+ *  A product tree of the moduli
+ * @return std::vector<polynomial>
+ *  One remainder per modulus, in the order the moduli were given
+ */
+std::vector<polynomial> remainders(const polynomial &f, const product_tree &moduli);
+
+/**
+ * @brief The inverse of remainders(): returns the unique f with
+ *        deg f < deg(moduli.root()) and f % m_i == residues[i] for every i.
+ *
+ * Each leaf contributes r_i * s_i, where s_i inverts (M / m_i) modulo m_i,
+ * and the contributions are combined bottom-up as f = f_L * P_R + f_R * P_L,
+ * so no division by M / m_i is ever done. The cofactors M / m_i mod m_i come
+ * from a top-down pass like the one in remainders(), and each inverse is found
+ * mod 2 with an extended GCD and lifted to mod 2^32 by Newton iteration. Every
+ * level runs in parallel.
+ *
+ * Over the wrapping integers this needs every modulus to have leading
+ * coefficient 1 or -1 and the moduli to be pairwise coprime mod 2 (which makes
+ * them coprime mod 2^32). Throws std::runtime_error if either fails, or if
+ * there isn't exactly one residue per modulus.
+ *
+ * @param residues
+ *  One residue per modulus, in the order the moduli were given
+ * @param moduli
+ *  A product tree of the moduli
+ * @return polynomial
+ *  The reconstructed polynomial
+ */
+polynomial chinese_remainder(const std::vector<polynomial> &residues, const product_tree &moduli);
+
+#endif